@@ -0,0 +1,177 @@
+#ifndef ALLOC_H__
+#define ALLOC_H__
+
+/*
+ * Accounting allocator behind the allocation hooks of the libraries.
+ *
+ * Every block gets a small header holding its size and the subsystem that
+ * allocated it, so frees and reallocs are charged back correctly. Per
+ * subsystem we keep live bytes, peak live bytes, allocation and free counts
+ * and a power-of-two size-class histogram of requested sizes, all updated
+ * with relaxed atomics. alloc_report() prints them while the program runs.
+ *
+ * Hook points:
+ *   cJSON        cJSON_InitHooks(&alloc_cjson_hooks)
+ *   rapidstring  RS_MALLOC / RS_REALLOC / RS_FREE, defined before the first
+ *                include of rapidstring.h
+ *   mbedtls      alloc_hook_mbedtls(), when mbedtls/platform.h with
+ *                MBEDTLS_PLATFORM_MEMORY is included first
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON/cJSON.h"
+
+// 保持 16 字节对齐
+#define ALLOC_HEADER 16
+#define ALLOC_CLASSES 33
+
+typedef enum {
+	ALLOC_CJSON,
+	ALLOC_RS,
+	ALLOC_MBEDTLS,
+	ALLOC_SUBSYSTEMS,
+} alloc_subsystem_t;
+
+typedef struct alloc_stats {
+	atomic_size_t live;
+	atomic_size_t peak;
+	atomic_uint_fast64_t allocs;
+	atomic_uint_fast64_t frees;
+	// 第 i 类为 (2^(i-1), 2^i] 字节, 第 0 类为 0 和 1 字节
+	atomic_uint_fast64_t classes[ALLOC_CLASSES];
+} alloc_stats_t;
+
+static alloc_stats_t s_alloc[ALLOC_SUBSYSTEMS];
+static const char* const s_alloc_names[ALLOC_SUBSYSTEMS] = { "cjson", "rapidstring", "mbedtls" };
+
+static inline size_t alloc_class(size_t n)
+{
+	size_t c = 0;
+	if (n > 1)
+		for (n--; n; n >>= 1)
+			c++;
+	return c < ALLOC_CLASSES ? c : ALLOC_CLASSES - 1;
+}
+
+static inline void alloc_charge(int sys, size_t n)
+{
+	alloc_stats_t* s = &s_alloc[sys];
+	size_t live = atomic_fetch_add_explicit(&s->live, n, memory_order_relaxed) + n;
+	size_t peak = atomic_load_explicit(&s->peak, memory_order_relaxed);
+	while (live > peak && !atomic_compare_exchange_weak_explicit(&s->peak, &peak, live, memory_order_relaxed,
+	                                                             memory_order_relaxed))
+		;
+	atomic_fetch_add_explicit(&s->allocs, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&s->classes[alloc_class(n)], 1, memory_order_relaxed);
+}
+
+static inline void alloc_release(int sys, size_t n)
+{
+	alloc_stats_t* s = &s_alloc[sys];
+	atomic_fetch_sub_explicit(&s->live, n, memory_order_relaxed);
+	atomic_fetch_add_explicit(&s->frees, 1, memory_order_relaxed);
+}
+
+static inline void* alloc_malloc(int sys, size_t n)
+{
+	if (n > SIZE_MAX - ALLOC_HEADER)
+		return NULL;
+	char* p = malloc(n + ALLOC_HEADER);
+	if (p == NULL)
+		return NULL;
+	*(size_t*)p = n;
+	*(int*)(p + sizeof(size_t)) = sys;
+	alloc_charge(sys, n);
+	return p + ALLOC_HEADER;
+}
+
+static inline void alloc_free(void* ptr)
+{
+	if (ptr == NULL)
+		return;
+	char* p = (char*)ptr - ALLOC_HEADER;
+	alloc_release(*(int*)(p + sizeof(size_t)), *(size_t*)p);
+	free(p);
+}
+
+// 按块原来所属的子系统记账, 计为一次释放和一次分配
+static inline void* alloc_realloc(int sys, void* ptr, size_t n)
+{
+	if (ptr == NULL)
+		return alloc_malloc(sys, n);
+	if (n > SIZE_MAX - ALLOC_HEADER)
+		return NULL;
+	char* old = (char*)ptr - ALLOC_HEADER;
+	size_t old_n = *(size_t*)old;
+	sys = *(int*)(old + sizeof(size_t));
+	char* p = realloc(old, n + ALLOC_HEADER);
+	if (p == NULL)
+		return NULL;
+	*(size_t*)p = n;
+	alloc_release(sys, old_n);
+	alloc_charge(sys, n);
+	return p + ALLOC_HEADER;
+}
+
+static inline void* alloc_calloc(int sys, size_t count, size_t size)
+{
+	if (size > 0 && count > SIZE_MAX / size)
+		return NULL;
+	void* p = alloc_malloc(sys, count * size);
+	if (p)
+		memset(p, 0, count * size);
+	return p;
+}
+
+static void* alloc_cjson_malloc(size_t n)
+{
+	return alloc_malloc(ALLOC_CJSON, n);
+}
+
+static cJSON_Hooks alloc_cjson_hooks = { alloc_cjson_malloc, alloc_free };
+
+#if defined(MBEDTLS_PLATFORM_MEMORY)
+static void* alloc_mbedtls_calloc(size_t count, size_t size)
+{
+	return alloc_calloc(ALLOC_MBEDTLS, count, size);
+}
+
+static inline int alloc_hook_mbedtls(void)
+{
+	return mbedtls_platform_set_calloc_free(alloc_mbedtls_calloc, alloc_free);
+}
+#endif
+
+static inline size_t alloc_live(int sys)
+{
+	return atomic_load_explicit(&s_alloc[sys].live, memory_order_relaxed);
+}
+
+// 打印各子系统的当前用量, 峰值, 次数, 以及各大小类的分配次数 (上界: 次数)
+static void alloc_report(FILE* f)
+{
+	fprintf(f, "%-12s %12s %12s %12s %12s\n", "alloc", "live", "peak", "allocs", "frees");
+	for (int i = 0; i < ALLOC_SUBSYSTEMS; i++) {
+		alloc_stats_t* s = &s_alloc[i];
+		uint64_t allocs = atomic_load_explicit(&s->allocs, memory_order_relaxed);
+		if (allocs == 0)
+			continue;
+		fprintf(f, "%-12s %12zu %12zu %12llu %12llu\n", s_alloc_names[i], alloc_live(i),
+		        atomic_load_explicit(&s->peak, memory_order_relaxed), (unsigned long long)allocs,
+		        (unsigned long long)atomic_load_explicit(&s->frees, memory_order_relaxed));
+		fprintf(f, "%-12s", "");
+		for (size_t c = 0; c < ALLOC_CLASSES; c++) {
+			uint64_t n = atomic_load_explicit(&s->classes[c], memory_order_relaxed);
+			if (n > 0)
+				fprintf(f, " %llu:%llu", 1ULL << c, (unsigned long long)n);
+		}
+		fprintf(f, "\n");
+	}
+	fflush(f);
+}
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef BENCH_H__
+#define BENCH_H__
+
+/*
+ * Microbenchmark harness.
+ *
+ * A benchmark is a function that runs its kernel `iters` times. The harness
+ * doubles iters until one repetition takes at least min_ns (which also warms
+ * caches and the allocator), runs `warmup` more repetitions unmeasured,
+ * then times `reps` repetitions and reports nanoseconds per operation as
+ * min / median / mean / stddev / max. Every result is one line of
+ * key=value pairs, so runs can be diffed and parsed by scripts.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#    include <windows.h>
+#else
+#    include <time.h>
+#endif
+
+#define BENCH_WARMUP 3
+#define BENCH_REPS 15
+#define BENCH_MIN_NS 20000000ULL
+#define BENCH_MAX_REPS 1000
+
+typedef void (*bench_fn)(void* ctx, size_t iters);
+
+typedef struct bench_config {
+	size_t warmup;
+	size_t reps;
+	uint64_t min_ns;
+} bench_config_t;
+
+static inline uint64_t bench_now_ns(void)
+{
+#if defined(_WIN32)
+	LARGE_INTEGER f, c;
+	QueryPerformanceFrequency(&f);
+	QueryPerformanceCounter(&c);
+	return (uint64_t)(c.QuadPart / f.QuadPart * 1000000000 + c.QuadPart % f.QuadPart * 1000000000 / f.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// 不依赖 libm
+static double bench_sqrt(double x)
+{
+	double r = x > 1 ? x : 1;
+	if (x <= 0)
+		return 0;
+	for (int i = 0; i < 64; i++)
+		r = (r + x / r) / 2;
+	return r;
+}
+
+static int bench_cmp(const void* a, const void* b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+// bytes 为每次操作处理的字节数, 不为 0 时同时输出吞吐量
+static void bench_run(const bench_config_t* cfg, const char* name, bench_fn fn, void* ctx, size_t bytes)
+{
+	double samples[BENCH_MAX_REPS];
+	char key[128];
+	size_t reps = cfg->reps < BENCH_MAX_REPS ? cfg->reps : BENCH_MAX_REPS;
+	size_t iters = 1;
+
+	if (reps == 0)
+		reps = 1;
+	for (;;) {
+		uint64_t t = bench_now_ns();
+		fn(ctx, iters);
+		if (bench_now_ns() - t >= cfg->min_ns || iters >= ((size_t)1 << 40))
+			break;
+		iters *= 2;
+	}
+	for (size_t i = 0; i < cfg->warmup; i++)
+		fn(ctx, iters);
+
+	double sum = 0;
+	for (size_t i = 0; i < reps; i++) {
+		uint64_t t = bench_now_ns();
+		fn(ctx, iters);
+		samples[i] = (double)(bench_now_ns() - t) / iters;
+		sum += samples[i];
+	}
+	qsort(samples, reps, sizeof(double), bench_cmp);
+
+	// 名字中的空格和 '=' 会破坏 key=value 格式
+	size_t n = 0;
+	for (; name[n] && n < sizeof(key) - 1; n++)
+		key[n] = (name[n] == ' ' || name[n] == '=') ? '_' : name[n];
+	key[n] = 0;
+
+	double mean = sum / reps, var = 0;
+	for (size_t i = 0; i < reps; i++)
+		var += (samples[i] - mean) * (samples[i] - mean);
+	double median = reps % 2 ? samples[reps / 2] : (samples[reps / 2 - 1] + samples[reps / 2]) / 2;
+
+	printf("bench=%s iters=%zu reps=%zu min_ns=%.1f median_ns=%.1f mean_ns=%.1f stddev_ns=%.1f max_ns=%.1f",
+	       key, iters, reps, samples[0], median, mean, reps > 1 ? bench_sqrt(var / (reps - 1)) : 0.0, samples[reps - 1]);
+	if (bytes > 0)
+		printf(" mb_s=%.1f", bytes / median * 1e9 / (1 << 20));
+	printf("\n");
+	fflush(stdout);
+}
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef CACHE_H__
+#define CACHE_H__
+
+/*
+ * Size-bounded LRU cache of key -> value byte strings, safe across threads.
+ *
+ * Keys are spread over CACHE_SHARDS shards by hash; every shard has its own
+ * mutex, chained hash table and LRU list, so threads only contend when they
+ * hit the same shard. A shard evicts from the cold end of its list until the
+ * bytes of its entries (key, value and entry header) fit in its share of the
+ * capacity. Values are copied out under the lock, so an entry may be evicted
+ * right after a lookup without harm.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "lite-list.h"
+#include "rapidstring.h"
+
+#ifndef container_of
+#    define container_of(ptr, type, member) \
+        ((type*)((char*)(ptr)-offsetof(type, member)))
+#endif
+
+#define CACHE_SHARDS 16
+#define CACHE_CACHE_LINE 64
+
+typedef struct cache_entry {
+	list_head_t lru;
+	// 同一个桶中的下一个词条
+	struct cache_entry* next;
+	uint64_t hash;
+	uint32_t key_len;
+	uint32_t value_len;
+	// key 后紧跟 value
+	char data[];
+} cache_entry_t;
+
+typedef struct cache_shard {
+	pthread_mutex_t lock;
+	cache_entry_t** buckets;
+	size_t mask;
+	size_t count;
+	size_t bytes;
+	size_t capacity;
+	// 表头是最近使用的词条
+	list_head_t lru;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	char pad[CACHE_CACHE_LINE];
+} cache_shard_t;
+
+typedef struct cache {
+	cache_shard_t shards[CACHE_SHARDS];
+} cache_t;
+
+typedef struct cache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	size_t entries;
+	size_t bytes;
+} cache_stats_t;
+
+static inline uint64_t cache_hash(const char* key, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < len; i++)
+		h = (h ^ (uint8_t)key[i]) * 0x100000001b3ULL;
+	return h ^ (h >> 29);
+}
+
+static inline cache_shard_t* cache_shard(cache_t* c, uint64_t hash)
+{
+	return &c->shards[hash >> 60 & (CACHE_SHARDS - 1)];
+}
+
+static inline int cache_init(cache_t* c, size_t capacity)
+{
+	memset(c, 0, sizeof(*c));
+	for (size_t i = 0; i < CACHE_SHARDS; i++) {
+		cache_shard_t* s = &c->shards[i];
+		pthread_mutex_init(&s->lock, NULL);
+		INIT_LIST_HEAD(&s->lru);
+		s->capacity = capacity / CACHE_SHARDS;
+		s->mask = 63;
+		s->buckets = calloc(s->mask + 1, sizeof(cache_entry_t*));
+		if (s->buckets == NULL)
+			return -1;
+	}
+	return 0;
+}
+
+static inline void cache_free(cache_t* c)
+{
+	for (size_t i = 0; i < CACHE_SHARDS; i++) {
+		cache_shard_t* s = &c->shards[i];
+		while (!list_empty(&s->lru)) {
+			cache_entry_t* e = list_first_entry(&s->lru, cache_entry_t, lru);
+			list_del(&e->lru);
+			free(e);
+		}
+		free(s->buckets);
+		pthread_mutex_destroy(&s->lock);
+	}
+	memset(c, 0, sizeof(*c));
+}
+
+static cache_entry_t** cache_slot(cache_shard_t* s, uint64_t hash, const char* key, size_t len)
+{
+	cache_entry_t** p = &s->buckets[hash & s->mask];
+	for (; *p; p = &(*p)->next) {
+		if ((*p)->hash == hash && (*p)->key_len == len && memcmp((*p)->data, key, len) == 0)
+			break;
+	}
+	return p;
+}
+
+static void cache_unlink(cache_shard_t* s, cache_entry_t* e)
+{
+	cache_entry_t** p = &s->buckets[e->hash & s->mask];
+	while (*p != e)
+		p = &(*p)->next;
+	*p = e->next;
+	list_del(&e->lru);
+	s->count--;
+	s->bytes -= sizeof(cache_entry_t) + e->key_len + e->value_len;
+}
+
+static void cache_grow(cache_shard_t* s)
+{
+	size_t mask = s->mask * 2 + 1;
+	cache_entry_t** buckets = calloc(mask + 1, sizeof(cache_entry_t*));
+	if (buckets == NULL)
+		return;
+	for (size_t i = 0; i <= s->mask; i++) {
+		cache_entry_t* e = s->buckets[i];
+		while (e) {
+			cache_entry_t* next = e->next;
+			e->next = buckets[e->hash & mask];
+			buckets[e->hash & mask] = e;
+			e = next;
+		}
+	}
+	free(s->buckets);
+	s->buckets = buckets;
+	s->mask = mask;
+}
+
+// 命中时把值追加到 out (可以为 NULL) 并返回 1
+static int cache_get(cache_t* c, const char* key, size_t len, rapidstring* out)
+{
+	uint64_t hash = cache_hash(key, len);
+	cache_shard_t* s = cache_shard(c, hash);
+
+	pthread_mutex_lock(&s->lock);
+	cache_entry_t* e = *cache_slot(s, hash, key, len);
+	if (e) {
+		list_move(&e->lru, &s->lru);
+		if (out)
+			rs_cat_n(out, e->data + e->key_len, e->value_len);
+		s->hits++;
+	} else {
+		s->misses++;
+	}
+	pthread_mutex_unlock(&s->lock);
+	return e != NULL;
+}
+
+// 写入或替换. 超过分片容量的值不缓存
+static void cache_put(cache_t* c, const char* key, size_t len, const char* value, size_t value_len)
+{
+	uint64_t hash = cache_hash(key, len);
+	cache_shard_t* s = cache_shard(c, hash);
+	size_t need = sizeof(cache_entry_t) + len + value_len;
+
+	if (need > s->capacity || len > UINT32_MAX || value_len > UINT32_MAX)
+		return;
+	cache_entry_t* e = malloc(need);
+	if (e == NULL)
+		return;
+	e->hash = hash;
+	e->key_len = (uint32_t)len;
+	e->value_len = (uint32_t)value_len;
+	memcpy(e->data, key, len);
+	memcpy(e->data + len, value, value_len);
+
+	pthread_mutex_lock(&s->lock);
+	cache_entry_t* old = *cache_slot(s, hash, key, len);
+	if (old) {
+		cache_unlink(s, old);
+		free(old);
+	}
+	while (s->bytes + need > s->capacity && !list_empty(&s->lru)) {
+		cache_entry_t* victim = list_last_entry(&s->lru, cache_entry_t, lru);
+		cache_unlink(s, victim);
+		free(victim);
+		s->evictions++;
+	}
+	if (s->count >= s->mask + 1)
+		cache_grow(s);
+	e->next = s->buckets[hash & s->mask];
+	s->buckets[hash & s->mask] = e;
+	list_add(&e->lru, &s->lru);
+	s->count++;
+	s->bytes += need;
+	pthread_mutex_unlock(&s->lock);
+}
+
+static inline void cache_remove(cache_t* c, const char* key, size_t len)
+{
+	uint64_t hash = cache_hash(key, len);
+	cache_shard_t* s = cache_shard(c, hash);
+
+	pthread_mutex_lock(&s->lock);
+	cache_entry_t* e = *cache_slot(s, hash, key, len);
+	if (e) {
+		cache_unlink(s, e);
+		free(e);
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+static void cache_stats(cache_t* c, cache_stats_t* stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	for (size_t i = 0; i < CACHE_SHARDS; i++) {
+		cache_shard_t* s = &c->shards[i];
+		pthread_mutex_lock(&s->lock);
+		stats->hits += s->hits;
+		stats->misses += s->misses;
+		stats->evictions += s->evictions;
+		stats->entries += s->count;
+		stats->bytes += s->bytes;
+		pthread_mutex_unlock(&s->lock);
+	}
+}
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef DICT_H__
+#define DICT_H__
+
+/*
+ * In-memory lookup index over the dic table.
+ *
+ * All keys and definitions are copied into one arena; a minimal perfect hash
+ * (see mph.h) maps a key to its entry, so a lookup is one hash, one pilot
+ * read and one key compare, and never touches SQLite. Built once, then only
+ * read; any number of threads may look up concurrently.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sqlite3.h>
+#include "rapidstring.h"
+#include "mph.h"
+
+#define SQL_DICT_ROWS "SELECT key, word FROM dic WHERE key IS NOT NULL AND word IS NOT NULL"
+
+typedef struct dict_entry {
+	uint32_t key;
+	uint32_t key_len;
+	uint32_t word;
+	uint32_t word_len;
+} dict_entry_t;
+
+typedef struct dict {
+	rapidstring arena;
+	// 按完美哈希的槽位排列
+	dict_entry_t* entries;
+	uint32_t count;
+	mph_t mph;
+	uint8_t* pilots;
+} dict_t;
+
+static inline void dict_free(dict_t* d)
+{
+	rs_free(&d->arena);
+	free(d->entries);
+	free(d->pilots);
+	memset(d, 0, sizeof(*d));
+}
+
+// 读取 dic 的全部词条. 成功返回 0
+static int dict_load(sqlite3* db, dict_t* d)
+{
+	sqlite3_stmt* s;
+	dict_entry_t* rows = NULL;
+	size_t cap = 0;
+	const char** keys = NULL;
+	size_t* lens = NULL;
+	uint32_t *pilots = NULL, *slots = NULL;
+	uint32_t buckets;
+	int rc = -1, step;
+
+	memset(d, 0, sizeof(*d));
+	rs_init(&d->arena);
+	if (sqlite3_prepare_v2(db, SQL_DICT_ROWS, -1, &s, NULL)) {
+		fprintf(stderr, "error: Prepare stmt %s failed, %s\n", SQL_DICT_ROWS, sqlite3_errmsg(db));
+		return -1;
+	}
+	while ((step = sqlite3_step(s)) == SQLITE_ROW) {
+		const char* key = (const char*)sqlite3_column_text(s, 0);
+		size_t key_len = sqlite3_column_bytes(s, 0);
+		const char* word = (const char*)sqlite3_column_text(s, 1);
+		size_t word_len = sqlite3_column_bytes(s, 1);
+
+		if (key_len == 0)
+			continue;
+		if (rs_len(&d->arena) + key_len + word_len > UINT32_MAX) {
+			fprintf(stderr, "error: Dictionary exceeds 4 GB\n");
+			goto done;
+		}
+		if (d->count == cap) {
+			cap = cap ? cap * 2 : 1024;
+			dict_entry_t* p = realloc(rows, cap * sizeof(dict_entry_t));
+			if (p == NULL)
+				goto done;
+			rows = p;
+		}
+		dict_entry_t* e = &rows[d->count++];
+		e->key = (uint32_t)rs_len(&d->arena);
+		e->key_len = (uint32_t)key_len;
+		rs_cat_n(&d->arena, key, key_len);
+		e->word = (uint32_t)rs_len(&d->arena);
+		e->word_len = (uint32_t)word_len;
+		rs_cat_n(&d->arena, word, word_len);
+	}
+	// SQLITE_BUSY 等错误也会结束循环, 不完整的索引不能替换当前的索引
+	if (step != SQLITE_DONE) {
+		fprintf(stderr, "error: Read dic failed (%d), %s\n", step, sqlite3_errmsg(db));
+		goto done;
+	}
+	if (d->count == 0) {
+		rc = 0;
+		goto done;
+	}
+
+	keys = malloc((size_t)d->count * sizeof(char*));
+	lens = malloc((size_t)d->count * sizeof(size_t));
+	d->entries = malloc((size_t)d->count * sizeof(dict_entry_t));
+	if (!keys || !lens || !d->entries)
+		goto done;
+	for (uint32_t i = 0; i < d->count; i++) {
+		keys[i] = rs_data_c(&d->arena) + rows[i].key;
+		lens[i] = rows[i].key_len;
+	}
+	if (mph_build(d->count, keys, lens, &d->mph.seed, &buckets, &pilots, &slots)) {
+		fprintf(stderr, "error: Build perfect hash over %u keys failed\n", d->count);
+		goto done;
+	}
+	d->pilots = malloc((size_t)buckets * 4);
+	if (d->pilots == NULL)
+		goto done;
+	for (uint32_t b = 0; b < buckets; b++) {
+		d->pilots[b * 4] = (uint8_t)pilots[b];
+		d->pilots[b * 4 + 1] = (uint8_t)(pilots[b] >> 8);
+		d->pilots[b * 4 + 2] = (uint8_t)(pilots[b] >> 16);
+		d->pilots[b * 4 + 3] = (uint8_t)(pilots[b] >> 24);
+	}
+	for (uint32_t i = 0; i < d->count; i++)
+		d->entries[i] = rows[slots[i]];
+	d->mph.n = d->count;
+	d->mph.buckets = buckets;
+	d->mph.pilots = d->pilots;
+	rc = 0;
+
+done:
+	sqlite3_finalize(s);
+	free(rows);
+	free(keys);
+	free(lens);
+	free(pilots);
+	free(slots);
+	if (rc)
+		dict_free(d);
+	return rc;
+}
+
+// 返回 key 的释义, 不存在时返回 NULL
+static inline const char* dict_lookup(const dict_t* d, const char* key, size_t len, size_t* word_len)
+{
+	if (d->count == 0)
+		return NULL;
+	const dict_entry_t* e = &d->entries[mph_lookup(&d->mph, key, len)];
+	const char* arena = rs_data_c(&d->arena);
+	if (e->key_len != len || memcmp(arena + e->key, key, len) != 0)
+		return NULL;
+	*word_len = e->word_len;
+	return arena + e->word;
+}
+
+static inline const char* dict_key(const dict_t* d, uint32_t i, size_t* len)
+{
+	*len = d->entries[i].key_len;
+	return rs_data_c(&d->arena) + d->entries[i].key;
+}
+
+#endif
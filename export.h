@@ -0,0 +1,49 @@
+#ifndef EXPORT_H__
+#define EXPORT_H__
+
+/*
+ * Pieces shared by the dictionary exporters in kindle.h and stardict.h.
+ *
+ * SQL_EXPORT_ROWS(order) reads key, definition and the known forms of every
+ * word in dic, the forms coming from the inflections table (seen in books)
+ * and from the word forms Youdao returned (word_forms), joined with spaces.
+ * The Youdao forms are free text ("lay 或 laid"), export_next_form() picks
+ * the English words out of them.
+ */
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#    include <direct.h>
+#    define export_mkdir(path) _mkdir(path)
+#else
+#    include <sys/stat.h>
+#    define export_mkdir(path) mkdir(path, 0755)
+#endif
+
+#define SQL_EXPORT_ROWS(order) \
+	"SELECT key, word, (SELECT group_concat(form, ' ') FROM (" \
+	"SELECT form FROM inflections WHERE inflections.key = dic.key UNION " \
+	"SELECT value FROM word_forms JOIN entries ON entries.id = word_forms.entry_id WHERE entries.key = dic.key)) " \
+	"FROM dic WHERE key IS NOT NULL AND word IS NOT NULL ORDER BY " order
+
+static inline int export_form_char(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == '\'';
+}
+
+// 返回 *p 之后的下一个英文单词, 长度写入 len 并把 *p 移到单词之后, 没有时返回 NULL
+static inline const char* export_next_form(const char** p, size_t* len)
+{
+	const char* q = *p;
+	while (*q && !export_form_char(*q))
+		q++;
+	const char* start = q;
+	while (export_form_char(*q))
+		q++;
+	*p = q;
+	*len = q - start;
+	return *len ? start : NULL;
+}
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef HISTO_H__
+#define HISTO_H__
+
+/*
+ * Log-linear latency histograms in the style of HdrHistogram.
+ *
+ * Values (microseconds) below 2^HISTO_SUB_BITS get a bucket each; above
+ * that every power of two is split into 2^HISTO_SUB_BITS linear buckets, so
+ * any recorded value is reported within about 3% of its true value while
+ * the whole range up to hours fits in HISTO_BUCKETS counters.
+ *
+ * Every thread records into its own set of histograms (one per stage),
+ * found through a thread-local pointer and linked into the registry on
+ * first use with a CAS. Recording is a relaxed load and store on memory no
+ * other thread writes, so there are no locks and no shared cache lines on
+ * the hot path; a report merges all threads' sets.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(_WIN32)
+#    include <windows.h>
+#endif
+
+#define HISTO_SUB_BITS 5
+#define HISTO_BUCKETS 1024
+#define HISTO_MAX_STAGES 16
+
+typedef struct histo {
+	atomic_uint_fast64_t counts[HISTO_BUCKETS];
+	atomic_uint_fast64_t max;
+} histo_t;
+
+typedef struct histo_local {
+	struct histo_local* next;
+	histo_t stages[HISTO_MAX_STAGES];
+} histo_local_t;
+
+typedef struct histo_registry {
+	const char* const* names;
+	size_t stages;
+	_Atomic(histo_local_t*) head;
+} histo_registry_t;
+
+static inline uint64_t histo_now_us(void)
+{
+#if defined(_WIN32)
+	LARGE_INTEGER f, c;
+	QueryPerformanceFrequency(&f);
+	QueryPerformanceCounter(&c);
+	return (uint64_t)(c.QuadPart / f.QuadPart * 1000000 + c.QuadPart % f.QuadPart * 1000000 / f.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#endif
+}
+
+static inline size_t histo_index(uint64_t v)
+{
+	int e = 0;
+	while ((v >> e) >= (2u << HISTO_SUB_BITS))
+		e++;
+	size_t i = ((size_t)e << HISTO_SUB_BITS) + (size_t)(v >> e);
+	return i < HISTO_BUCKETS ? i : HISTO_BUCKETS - 1;
+}
+
+// 桶内的最大值
+static inline uint64_t histo_value(size_t i)
+{
+	if (i < (2u << HISTO_SUB_BITS))
+		return i;
+	int e = (int)(i >> HISTO_SUB_BITS) - 1;
+	uint64_t m = i - ((size_t)e << HISTO_SUB_BITS);
+	return ((m + 1) << e) - 1;
+}
+
+// 只有所属线程写入, 不需要读-改-写
+static inline void histo_add(histo_t* h, uint64_t v)
+{
+	atomic_uint_fast64_t* c = &h->counts[histo_index(v)];
+	atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + 1, memory_order_relaxed);
+	if (v > atomic_load_explicit(&h->max, memory_order_relaxed))
+		atomic_store_explicit(&h->max, v, memory_order_relaxed);
+}
+
+static inline void histo_init(histo_registry_t* r, const char* const* names, size_t stages)
+{
+	r->names = names;
+	r->stages = stages < HISTO_MAX_STAGES ? stages : HISTO_MAX_STAGES;
+	atomic_init(&r->head, NULL);
+}
+
+// 当前线程的直方图, 第一次调用时分配并加入链表. 线程退出后保留, 报告时仍然计入.
+// 线程局部指针不区分注册表, 一个程序只使用一个注册表
+static inline histo_local_t* histo_local(histo_registry_t* r)
+{
+	static _Thread_local histo_local_t* local;
+	if (local == NULL) {
+		histo_local_t* l = calloc(1, sizeof(histo_local_t));
+		if (l == NULL)
+			return NULL;
+		l->next = atomic_load(&r->head);
+		while (!atomic_compare_exchange_weak(&r->head, &l->next, l))
+			;
+		local = l;
+	}
+	return local;
+}
+
+static inline void histo_record(histo_registry_t* r, size_t stage, uint64_t us)
+{
+	histo_local_t* l = histo_local(r);
+	if (l && stage < r->stages)
+		histo_add(&l->stages[stage], us);
+}
+
+// 合并后的第 q 分位数 (0..1)
+static uint64_t histo_percentile(const uint64_t* counts, uint64_t total, double q)
+{
+	uint64_t rank = (uint64_t)(q * total + 0.5);
+	uint64_t seen = 0;
+	if (rank < 1)
+		rank = 1;
+	for (size_t i = 0; i < HISTO_BUCKETS; i++) {
+		seen += counts[i];
+		if (seen >= rank)
+			return histo_value(i);
+	}
+	return histo_value(HISTO_BUCKETS - 1);
+}
+
+// 合并所有线程并打印每个阶段的 p50/p90/p99/max, 没有记录的阶段不打印
+static void histo_report(histo_registry_t* r, FILE* f)
+{
+	uint64_t counts[HISTO_BUCKETS];
+
+	fprintf(f, "%-10s %10s %10s %10s %10s %10s\n", "stage(us)", "count", "p50", "p90", "p99", "max");
+	for (size_t s = 0; s < r->stages; s++) {
+		uint64_t total = 0, max = 0;
+		for (size_t i = 0; i < HISTO_BUCKETS; i++)
+			counts[i] = 0;
+		for (histo_local_t* l = atomic_load(&r->head); l; l = l->next) {
+			const histo_t* h = &l->stages[s];
+			for (size_t i = 0; i < HISTO_BUCKETS; i++)
+				counts[i] += atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+			uint64_t m = atomic_load_explicit(&h->max, memory_order_relaxed);
+			if (m > max)
+				max = m;
+		}
+		for (size_t i = 0; i < HISTO_BUCKETS; i++)
+			total += counts[i];
+		if (total == 0)
+			continue;
+		uint64_t p50 = histo_percentile(counts, total, 0.50);
+		uint64_t p90 = histo_percentile(counts, total, 0.90);
+		uint64_t p99 = histo_percentile(counts, total, 0.99);
+		// 桶的上界可能超过实际的最大值
+		fprintf(f, "%-10s %10llu %10llu %10llu %10llu %10llu\n", r->names[s], (unsigned long long)total,
+		        (unsigned long long)(p50 < max ? p50 : max), (unsigned long long)(p90 < max ? p90 : max),
+		        (unsigned long long)(p99 < max ? p99 : max), (unsigned long long)max);
+	}
+	fflush(f);
+}
+
+#endif
@@ -0,0 +1,640 @@
+#ifndef IMAGE_H__
+#define IMAGE_H__
+
+/*
+ * Read-only dictionary image compiled from the dic table.
+ *
+ * The file is mapped into memory as is, nothing is parsed or allocated on
+ * load or lookup. All integers are little-endian.
+ *
+ *   header     IMAGE_HEADER_SIZE bytes, see image_open()
+ *   blocks     u32[blocks]     offset of every key block inside keys
+ *   keys       front-coded keys in sorted (memcmp) order. Every block of
+ *              block_size keys starts with a full key (varint len, bytes),
+ *              the others store (varint shared prefix, varint suffix len,
+ *              suffix bytes) relative to the previous key
+ *   offsets    u32[count + 1]  start of every entry inside heap
+ *   heap       entries: varint key length, key, definition (not NUL
+ *              terminated). The key is stored in full so a hash lookup
+ *              can verify its entry without decoding a key block
+ *
+ * An optional minimal perfect hash section follows at the next 4 byte
+ * boundary after the heap, so exact lookups skip the block search:
+ *
+ *   header     IMAGE_MPH_HEADER_SIZE bytes: magic, n, buckets, seed
+ *   pilots     u32[buckets]    see mph.h
+ *   entries    u32[n]          entry index stored in every slot
+ *
+ * followed, again 4 byte aligned, by an optional trie section for prefix
+ * completion (see trie.h):
+ *
+ *   header     magic, u64 size
+ *   trie       size bytes
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sqlite3.h>
+#include "rapidstring.h"
+#include "mph.h"
+#include "trie.h"
+
+#if defined(_WIN32)
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+#define IMAGE_MAGIC "YDDICT02"
+#define IMAGE_HEADER_SIZE 64
+#define IMAGE_BLOCK_SIZE 16
+// 导出时跳过更长的 key, 查找时用固定大小的栈缓冲区还原 key
+#define IMAGE_MAX_KEY 256
+#define IMAGE_MPH_MAGIC "YDMPH002"
+#define IMAGE_MPH_HEADER_SIZE 32
+#define IMAGE_TRIE_MAGIC "YDTRIE01"
+#define IMAGE_TRIE_HEADER_SIZE 16
+
+#define SQL_IMAGE_ROWS "SELECT key, word FROM dic WHERE key IS NOT NULL AND word IS NOT NULL ORDER BY key"
+
+typedef struct image {
+	const uint8_t* base;
+	size_t size;
+	uint32_t count;
+	uint32_t block_size;
+	uint32_t blocks;
+	const uint8_t* block_index;
+	const uint8_t* keys;
+	const uint8_t* keys_end;
+	const uint8_t* offsets;
+	const uint8_t* heap;
+	uint32_t heap_size;
+	// 没有完美哈希段时 mph.n 为 0
+	mph_t mph;
+	const uint8_t* mph_entries;
+	// 没有前缀树段时为 NULL
+	const uint8_t* trie;
+	size_t trie_size;
+#if defined(_WIN32)
+	HANDLE file;
+	HANDLE mapping;
+#endif
+} image_t;
+
+// 顺序遍历所有词条
+typedef struct image_cursor {
+	const image_t* img;
+	// 当前词条的序号
+	uint32_t index;
+	uint32_t next;
+	const uint8_t* p;
+	char key[IMAGE_MAX_KEY];
+	size_t key_len;
+} image_cursor_t;
+
+static inline uint32_t image_u32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t image_u64(const uint8_t* p)
+{
+	return (uint64_t)image_u32(p) | ((uint64_t)image_u32(p + 4) << 32);
+}
+
+static inline const uint8_t* image_varint(const uint8_t* p, const uint8_t* end, size_t* value)
+{
+	size_t v = 0;
+	for (int shift = 0; p < end && shift < 64; shift += 7) {
+		uint8_t b = *p++;
+		v |= (size_t)(b & 0x7F) << shift;
+		if ((b & 0x80) == 0) {
+			*value = v;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static inline void image_put_u32(rapidstring* s, uint32_t v)
+{
+	char b[4] = { (char)v, (char)(v >> 8), (char)(v >> 16), (char)(v >> 24) };
+	rs_cat_n(s, b, 4);
+}
+
+static inline void image_put_u64(rapidstring* s, uint64_t v)
+{
+	image_put_u32(s, (uint32_t)v);
+	image_put_u32(s, (uint32_t)(v >> 32));
+}
+
+static inline void image_put_varint(rapidstring* s, size_t v)
+{
+	char b[10];
+	size_t n = 0;
+	do {
+		b[n++] = (char)((v & 0x7F) | (v > 0x7F ? 0x80 : 0));
+		v >>= 7;
+	} while (v);
+	rs_cat_n(s, b, n);
+}
+
+// 把 count 个 key 的完美哈希段写入 s
+static int image_build_mph(rapidstring* s, uint32_t count, const char* raw, const size_t* raw_offsets, size_t raw_len)
+{
+	const char** keys = malloc((size_t)count * sizeof(char*));
+	size_t* lens = malloc((size_t)count * sizeof(size_t));
+	uint32_t *pilots = NULL, *slots = NULL;
+	uint32_t buckets;
+	uint64_t seed;
+	int rc = -1;
+
+	if (!keys || !lens)
+		goto done;
+	for (uint32_t i = 0; i < count; i++) {
+		keys[i] = raw + raw_offsets[i];
+		lens[i] = (i + 1 < count ? raw_offsets[i + 1] : raw_len) - raw_offsets[i];
+	}
+	if (mph_build(count, keys, lens, &seed, &buckets, &pilots, &slots))
+		goto done;
+
+	rs_cat_n(s, IMAGE_MPH_MAGIC, 8);
+	image_put_u32(s, count);
+	image_put_u32(s, buckets);
+	image_put_u64(s, seed);
+	rs_resize_w(s, IMAGE_MPH_HEADER_SIZE, 0);
+	for (uint32_t b = 0; b < buckets; b++)
+		image_put_u32(s, pilots[b]);
+	// 槽中只存词条序号, 比较时用 heap 中的 key
+	for (uint32_t i = 0; i < count; i++)
+		image_put_u32(s, slots[i]);
+	rc = 0;
+
+done:
+	free(keys);
+	free(lens);
+	free(pilots);
+	free(slots);
+	return rc;
+}
+
+// 把 count 个有序 key 的前缀树段写入 s
+static void image_build_trie(rapidstring* s, uint32_t count, const char* raw, const size_t* raw_offsets, size_t raw_len)
+{
+	const char** keys = malloc((size_t)count * sizeof(char*));
+	size_t* lens = malloc((size_t)count * sizeof(size_t));
+	if (keys && lens) {
+		for (uint32_t i = 0; i < count; i++) {
+			keys[i] = raw + raw_offsets[i];
+			lens[i] = (i + 1 < count ? raw_offsets[i + 1] : raw_len) - raw_offsets[i];
+		}
+		rapidstring t;
+		rs_init(&t);
+		trie_build(&t, count, keys, lens);
+		rs_cat_n(s, IMAGE_TRIE_MAGIC, 8);
+		image_put_u64(s, rs_len(&t));
+		rs_cat_rs(s, &t);
+		rs_free(&t);
+	}
+	free(keys);
+	free(lens);
+}
+
+// 按 key 排序读取 dic, 写入 path. 成功返回写入的词条数, 失败返回 -1
+static long image_export(sqlite3* db, const char* path)
+{
+	sqlite3_stmt* s;
+	if (sqlite3_prepare_v2(db, SQL_IMAGE_ROWS, -1, &s, NULL)) {
+		fprintf(stderr, "error: Prepare stmt %s failed, %s\n", SQL_IMAGE_ROWS, sqlite3_errmsg(db));
+		return -1;
+	}
+
+	rapidstring blocks, keys, offsets, heap, raw, mph, trie;
+	rs_init(&blocks);
+	rs_init(&keys);
+	rs_init(&offsets);
+	rs_init(&heap);
+	rs_init(&raw);
+	rs_init(&mph);
+	rs_init(&trie);
+	// 完整的 key 和它们在 raw 中的起始位置, 用于构建完美哈希
+	size_t* raw_offsets = NULL;
+	size_t raw_cap = 0;
+
+	char prev[IMAGE_MAX_KEY];
+	size_t prev_len = 0;
+	uint32_t count = 0;
+	char* tmp = NULL;
+	long rc = -1;
+	int step;
+
+	while ((step = sqlite3_step(s)) == SQLITE_ROW) {
+		const char* key = (const char*)sqlite3_column_text(s, 0);
+		size_t key_len = sqlite3_column_bytes(s, 0);
+		const char* word = (const char*)sqlite3_column_text(s, 1);
+		size_t word_len = sqlite3_column_bytes(s, 1);
+
+		if (key_len == 0 || key_len > IMAGE_MAX_KEY)
+			continue;
+		if (rs_len(&heap) + 10 + key_len + word_len > UINT32_MAX) {
+			fprintf(stderr, "error: Definitions exceed 4 GB\n");
+			goto error;
+		}
+
+		if (count % IMAGE_BLOCK_SIZE == 0) {
+			image_put_u32(&blocks, (uint32_t)rs_len(&keys));
+			image_put_varint(&keys, key_len);
+			rs_cat_n(&keys, key, key_len);
+		} else {
+			size_t shared = 0;
+			while (shared < prev_len && shared < key_len && prev[shared] == key[shared])
+				shared++;
+			image_put_varint(&keys, shared);
+			image_put_varint(&keys, key_len - shared);
+			rs_cat_n(&keys, key + shared, key_len - shared);
+		}
+		memcpy(prev, key, key_len);
+		prev_len = key_len;
+
+		if (count + 1 >= raw_cap) {
+			size_t cap = raw_cap ? raw_cap * 2 : 1024;
+			size_t* p = realloc(raw_offsets, cap * sizeof(size_t));
+			if (p == NULL) {
+				fprintf(stderr, "error: Out of memory\n");
+				goto error;
+			}
+			raw_offsets = p;
+			raw_cap = cap;
+		}
+		raw_offsets[count] = rs_len(&raw);
+		rs_cat_n(&raw, key, key_len);
+
+		image_put_u32(&offsets, (uint32_t)rs_len(&heap));
+		image_put_varint(&heap, key_len);
+		rs_cat_n(&heap, key, key_len);
+		rs_cat_n(&heap, word, word_len);
+		count++;
+	}
+	// SQLITE_BUSY 等错误也会结束循环, 不完整的镜像不能替换原来的文件
+	if (step != SQLITE_DONE) {
+		fprintf(stderr, "error: Read dic failed (%d), %s\n", step, sqlite3_errmsg(db));
+		goto error;
+	}
+	image_put_u32(&offsets, (uint32_t)rs_len(&heap));
+
+	if (count > 0 && image_build_mph(&mph, count, rs_data(&raw), raw_offsets, rs_len(&raw)))
+		fprintf(stderr, "warning: Build perfect hash failed, lookups use the sorted keys only\n");
+	if (count > 0)
+		image_build_trie(&trie, count, rs_data(&raw), raw_offsets, rs_len(&raw));
+
+	uint32_t nblocks = (count + IMAGE_BLOCK_SIZE - 1) / IMAGE_BLOCK_SIZE;
+	uint64_t blocks_offset = IMAGE_HEADER_SIZE;
+	uint64_t keys_offset = blocks_offset + rs_len(&blocks);
+	uint64_t offsets_offset = keys_offset + rs_len(&keys);
+	// 偏移表按 4 字节对齐
+	uint64_t padding = (4 - offsets_offset % 4) % 4;
+	offsets_offset += padding;
+	uint64_t heap_offset = offsets_offset + rs_len(&offsets);
+	uint64_t heap_end = heap_offset + rs_len(&heap);
+	uint64_t mph_padding = (4 - heap_end % 4) % 4;
+	uint64_t trie_padding = (4 - (heap_end + mph_padding + rs_len(&mph)) % 4) % 4;
+
+	rapidstring header;
+	rs_init(&header);
+	rs_cat_n(&header, IMAGE_MAGIC, 8);
+	image_put_u32(&header, count);
+	image_put_u32(&header, IMAGE_BLOCK_SIZE);
+	image_put_u32(&header, nblocks);
+	image_put_u32(&header, 0);
+	image_put_u64(&header, blocks_offset);
+	image_put_u64(&header, keys_offset);
+	image_put_u64(&header, offsets_offset);
+	image_put_u64(&header, heap_offset);
+	image_put_u64(&header, heap_end);
+	rs_resize_w(&header, IMAGE_HEADER_SIZE, 0);
+
+	// 先写临时文件再重命名, 正在使用旧文件的读取者不受影响
+	size_t tmp_len = strlen(path) + 5;
+	tmp = malloc(tmp_len);
+	snprintf(tmp, tmp_len, "%s.tmp", path);
+	FILE* f = fopen(tmp, "wb");
+	if (!f) {
+		fprintf(stderr, "error: Can't open %s\n", tmp);
+		goto error_header;
+	}
+	static const char zeros[4] = { 0 };
+	int ok = fwrite(rs_data(&header), 1, rs_len(&header), f) == rs_len(&header) &&
+	         fwrite(rs_data(&blocks), 1, rs_len(&blocks), f) == rs_len(&blocks) &&
+	         fwrite(rs_data(&keys), 1, rs_len(&keys), f) == rs_len(&keys) &&
+	         fwrite(zeros, 1, padding, f) == padding &&
+	         fwrite(rs_data(&offsets), 1, rs_len(&offsets), f) == rs_len(&offsets) &&
+	         fwrite(rs_data(&heap), 1, rs_len(&heap), f) == rs_len(&heap) &&
+	         fwrite(zeros, 1, mph_padding, f) == mph_padding &&
+	         fwrite(rs_data(&mph), 1, rs_len(&mph), f) == rs_len(&mph) &&
+	         (rs_empty(&trie) ||
+	          (fwrite(zeros, 1, trie_padding, f) == trie_padding &&
+	           fwrite(rs_data(&trie), 1, rs_len(&trie), f) == rs_len(&trie)));
+	ok = (fclose(f) == 0) && ok;
+	if (!ok) {
+		fprintf(stderr, "error: Write %s failed\n", tmp);
+		remove(tmp);
+		goto error_header;
+	}
+#if defined(_WIN32)
+	ok = MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING);
+#else
+	ok = rename(tmp, path) == 0;
+#endif
+	if (!ok) {
+		fprintf(stderr, "error: Rename %s to %s failed\n", tmp, path);
+		remove(tmp);
+		goto error_header;
+	}
+	rc = count;
+
+error_header:
+	rs_free(&header);
+	free(tmp);
+error:
+	rs_free(&blocks);
+	rs_free(&keys);
+	rs_free(&offsets);
+	rs_free(&heap);
+	rs_free(&raw);
+	rs_free(&mph);
+	rs_free(&trie);
+	free(raw_offsets);
+	sqlite3_finalize(s);
+	return rc;
+}
+
+static void image_close(image_t* img)
+{
+	if (img->base == NULL)
+		return;
+#if defined(_WIN32)
+	UnmapViewOfFile(img->base);
+	CloseHandle(img->mapping);
+	CloseHandle(img->file);
+#else
+	munmap((void*)img->base, img->size);
+#endif
+	img->base = NULL;
+}
+
+static int image_open(image_t* img, const char* path)
+{
+	memset(img, 0, sizeof(*img));
+
+#if defined(_WIN32)
+	img->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+	                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (img->file == INVALID_HANDLE_VALUE)
+		return -1;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(img->file, &size) || size.QuadPart < IMAGE_HEADER_SIZE) {
+		CloseHandle(img->file);
+		return -1;
+	}
+	img->mapping = CreateFileMappingA(img->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (img->mapping == NULL) {
+		CloseHandle(img->file);
+		return -1;
+	}
+	img->base = MapViewOfFile(img->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (img->base == NULL) {
+		CloseHandle(img->mapping);
+		CloseHandle(img->file);
+		return -1;
+	}
+	img->size = (size_t)size.QuadPart;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < IMAGE_HEADER_SIZE) {
+		close(fd);
+		return -1;
+	}
+	void* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return -1;
+	img->base = base;
+	img->size = st.st_size;
+#endif
+
+	const uint8_t* h = img->base;
+	if (memcmp(h, IMAGE_MAGIC, 8) != 0)
+		goto error;
+	img->count = image_u32(h + 8);
+	img->block_size = image_u32(h + 12);
+	img->blocks = image_u32(h + 16);
+	uint64_t blocks_offset = image_u64(h + 24);
+	uint64_t keys_offset = image_u64(h + 32);
+	uint64_t offsets_offset = image_u64(h + 40);
+	uint64_t heap_offset = image_u64(h + 48);
+	uint64_t end = image_u64(h + 56);
+
+	// 各段必须按顺序排列且都在文件内
+	if (img->block_size == 0 || end > img->size ||
+	        blocks_offset + (uint64_t)img->blocks * 4 > keys_offset ||
+	        keys_offset > offsets_offset ||
+	        offsets_offset + ((uint64_t)img->count + 1) * 4 > heap_offset ||
+	        heap_offset > end ||
+	        img->blocks != (img->count + img->block_size - 1) / img->block_size)
+		goto error;
+
+	img->block_index = h + blocks_offset;
+	img->keys = h + keys_offset;
+	img->keys_end = h + offsets_offset;
+	img->offsets = h + offsets_offset;
+	img->heap = h + heap_offset;
+	img->heap_size = image_u32(img->offsets + (size_t)img->count * 4);
+	if (img->heap_size > end - heap_offset)
+		goto error;
+
+	// 可选的附加段
+	uint64_t section = end + (4 - end % 4) % 4;
+	uint64_t mph_offset = section;
+	if (mph_offset + IMAGE_MPH_HEADER_SIZE <= img->size && memcmp(h + mph_offset, IMAGE_MPH_MAGIC, 8) == 0) {
+		const uint8_t* m = h + mph_offset;
+		uint32_t n = image_u32(m + 8);
+		uint32_t buckets = image_u32(m + 12);
+		uint64_t size = IMAGE_MPH_HEADER_SIZE + (uint64_t)buckets * 4 + (uint64_t)n * 4;
+		if (n != img->count || buckets == 0 || mph_offset + size > img->size)
+			goto error;
+		img->mph.n = n;
+		img->mph.buckets = buckets;
+		img->mph.seed = image_u64(m + 16);
+		img->mph.pilots = m + IMAGE_MPH_HEADER_SIZE;
+		img->mph_entries = img->mph.pilots + (size_t)buckets * 4;
+		section = mph_offset + size;
+		section += (4 - section % 4) % 4;
+	}
+	if (section + IMAGE_TRIE_HEADER_SIZE <= img->size && memcmp(h + section, IMAGE_TRIE_MAGIC, 8) == 0) {
+		uint64_t size = image_u64(h + section + 8);
+		if (size > img->size - section - IMAGE_TRIE_HEADER_SIZE)
+			goto error;
+		img->trie = h + section + IMAGE_TRIE_HEADER_SIZE;
+		img->trie_size = size;
+	}
+	return 0;
+
+error:
+	image_close(img);
+	return -1;
+}
+
+// 读取第 index 个词条的 key 和释义, 序号或偏移越界 (镜像损坏) 时返回 -1
+static inline int image_entry(const image_t* img, uint32_t index, const char** key, size_t* key_len,
+                              const char** word, size_t* word_len)
+{
+	if (index >= img->count)
+		return -1;
+	uint32_t start = image_u32(img->offsets + (size_t)index * 4);
+	uint32_t end = image_u32(img->offsets + (size_t)index * 4 + 4);
+	if (end < start || end > img->heap_size)
+		return -1;
+	const uint8_t* p = img->heap + start;
+	const uint8_t* e = img->heap + end;
+	size_t n;
+	if ((p = image_varint(p, e, &n)) == NULL || n > (size_t)(e - p))
+		return -1;
+	*key = (const char*)p;
+	*key_len = n;
+	*word = (const char*)p + n;
+	*word_len = (size_t)(e - p) - n;
+	return 0;
+}
+
+// 返回第 index 个词条的释义, 镜像损坏时返回 NULL
+static inline const char* image_definition(const image_t* img, uint32_t index, size_t* len)
+{
+	const char *key, *word;
+	size_t key_len;
+	if (image_entry(img, index, &key, &key_len, &word, len))
+		return NULL;
+	return word;
+}
+
+static inline int image_compare(const char* a, size_t a_len, const char* b, size_t b_len)
+{
+	int c = memcmp(a, b, a_len < b_len ? a_len : b_len);
+	if (c != 0)
+		return c;
+	return (a_len > b_len) - (a_len < b_len);
+}
+
+// 还原块中的下一个 key, 返回 NULL 表示数据损坏
+static inline const uint8_t* image_next_key(const image_t* img, const uint8_t* p, int first, char* key, size_t* key_len)
+{
+	size_t shared = 0, n;
+	if (!first && (p = image_varint(p, img->keys_end, &shared)) == NULL)
+		return NULL;
+	if ((p = image_varint(p, img->keys_end, &n)) == NULL)
+		return NULL;
+	if (shared > *key_len || shared + n > IMAGE_MAX_KEY || n > (size_t)(img->keys_end - p))
+		return NULL;
+	memcpy(key + shared, p, n);
+	*key_len = shared + n;
+	return p + n;
+}
+
+// 返回词条序号, 找不到时返回 -1
+static long image_find(const image_t* img, const char* key, size_t key_len)
+{
+	if (img->count == 0)
+		return -1;
+
+	// 一次哈希, 一次读取, 一次比较
+	if (img->mph.n > 0) {
+		uint32_t slot = mph_lookup(&img->mph, key, key_len);
+		uint32_t entry = image_u32(img->mph_entries + (size_t)slot * 4);
+		const char *found, *word;
+		size_t found_len, word_len;
+		if (image_entry(img, entry, &found, &found_len, &word, &word_len) || found_len != key_len ||
+		        memcmp(found, key, key_len) != 0)
+			return -1;
+		return entry;
+	}
+
+	// 二分查找最后一个首个 key 不大于 key 的块
+	uint32_t lo = 0, hi = img->blocks;
+	while (hi - lo > 1) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		const uint8_t* p = img->keys + image_u32(img->block_index + (size_t)mid * 4);
+		size_t n;
+		if ((p = image_varint(p, img->keys_end, &n)) == NULL)
+			return -1;
+		if (n > (size_t)(img->keys_end - p))
+			return -1;
+		if (image_compare((const char*)p, n, key, key_len) <= 0)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	char buf[IMAGE_MAX_KEY];
+	size_t buf_len = 0;
+	uint32_t index = lo * img->block_size;
+	const uint8_t* p = img->keys + image_u32(img->block_index + (size_t)lo * 4);
+	for (uint32_t i = 0; i < img->block_size && index < img->count; i++, index++) {
+		if ((p = image_next_key(img, p, i == 0, buf, &buf_len)) == NULL)
+			return -1;
+		int c = image_compare(buf, buf_len, key, key_len);
+		if (c == 0)
+			return index;
+		if (c > 0)
+			break;
+	}
+	return -1;
+}
+
+// 返回释义, 找不到时返回 NULL
+static inline const char* image_lookup(const image_t* img, const char* key, size_t key_len, size_t* len)
+{
+	long index = image_find(img, key, key_len);
+	if (index < 0)
+		return NULL;
+	return image_definition(img, (uint32_t)index, len);
+}
+
+// 按字典序枚举以 prefix 开头的单词, 返回枚举的数量
+static inline size_t image_complete(const image_t* img, const char* prefix, size_t len,
+                                    size_t limit, trie_visit_fn visit, void* ctx)
+{
+	if (img->trie == NULL)
+		return 0;
+	return trie_complete(img->trie, img->trie_size, prefix, len, limit, visit, ctx);
+}
+
+static inline void image_cursor_init(image_cursor_t* c, const image_t* img)
+{
+	c->img = img;
+	c->index = 0;
+	c->next = 0;
+	c->p = img->keys;
+	c->key_len = 0;
+}
+
+// 读取下一个 key 到 c->key, 结束时返回 0
+static inline int image_next(image_cursor_t* c)
+{
+	const image_t* img = c->img;
+	if (c->next >= img->count || c->p == NULL)
+		return 0;
+	c->p = image_next_key(img, c->p, c->next % img->block_size == 0, c->key, &c->key_len);
+	if (c->p == NULL)
+		return 0;
+	c->index = c->next++;
+	return 1;
+}
+
+#endif
@@ -0,0 +1,393 @@
+#ifndef KINDLE_H__
+#define KINDLE_H__
+
+/*
+ * Kindle dictionary source exported from the dic table.
+ *
+ * One cursor walks dic in key order and cuts the rows into jobs of
+ * KINDLE_JOB_ROWS; a pool of worker threads renders every job to HTML with
+ * idx:orth / idx:infl markup, and a writer thread appends the rendered jobs
+ * to the content files strictly in sequence, so the output is sorted no
+ * matter which worker finishes first. At most KINDLE_QUEUE_DEPTH jobs are in
+ * flight, which bounds memory for any dictionary size.
+ *
+ *   <dir>/content<n>.html   KINDLE_FILE_JOBS jobs each
+ *   <dir>/youdao.opf        manifest and spine, input for kindlegen
+ *
+ * Inflections come from the inflections table (forms seen in books) and from
+ * the word forms Youdao returned (word_forms).
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sqlite3.h>
+#include "rapidstring.h"
+#include "export.h"
+
+#define KINDLE_JOB_ROWS 1024
+#define KINDLE_FILE_JOBS 8
+#define KINDLE_QUEUE_DEPTH 16
+#define KINDLE_THREADS 4
+#define KINDLE_MAX_PATH 1024
+#define KINDLE_MAX_FORMS 64
+
+#define SQL_KINDLE_ROWS SQL_EXPORT_ROWS("key")
+
+#define KINDLE_HTML_HEADER \
+	"<html xmlns:mbp=\"https://kindlegen.s3.amazonaws.com/AmazonKindlePublishingGuidelines.pdf\" " \
+	"xmlns:idx=\"https://kindlegen.s3.amazonaws.com/AmazonKindlePublishingGuidelines.pdf\">\n" \
+	"<head><meta http-equiv=\"Content-Type\" content=\"text/html; charset=utf-8\"/></head>\n" \
+	"<body>\n<mbp:frameset>\n"
+#define KINDLE_HTML_FOOTER "</mbp:frameset>\n</body>\n</html>\n"
+
+typedef struct kindle_job {
+	size_t seq;
+	// 输入: key\0word\0forms\0 记录
+	rapidstring rows;
+	size_t count;
+	// 输出: 渲染后的词条
+	rapidstring html;
+	struct kindle_job* next;
+} kindle_job_t;
+
+typedef struct kindle {
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	// 等待渲染的任务, 先进先出
+	kindle_job_t* todo;
+	kindle_job_t** todo_tail;
+	// 渲染完成的任务, 按 seq % KINDLE_QUEUE_DEPTH 存放
+	kindle_job_t* done[KINDLE_QUEUE_DEPTH];
+	size_t in_flight;
+	size_t jobs;
+	int closed;
+
+	const char* dir;
+	size_t files;
+	// 写入线程和主线程都会设置
+	atomic_int failed;
+} kindle_t;
+
+static void kindle_escape(rapidstring* out, const char* s, size_t len)
+{
+	size_t start = 0;
+	for (size_t i = 0; i < len; i++) {
+		const char* rep;
+		switch (s[i]) {
+		case '&': rep = "&amp;"; break;
+		case '<': rep = "&lt;"; break;
+		case '>': rep = "&gt;"; break;
+		case '"': rep = "&quot;"; break;
+		default: continue;
+		}
+		rs_cat_n(out, s + start, i - start);
+		rs_cat(out, rep);
+		start = i + 1;
+	}
+	rs_cat_n(out, s + start, len - start);
+}
+
+// 去掉与单词本身相同的和重复的词形
+static void kindle_render_forms(rapidstring* out, const char* key, size_t key_len, const char* forms)
+{
+	const char* seen[KINDLE_MAX_FORMS];
+	size_t seen_len[KINDLE_MAX_FORMS];
+	size_t n = 0;
+	const char* p = forms;
+	const char* start;
+	size_t len;
+
+	while (n < KINDLE_MAX_FORMS && (start = export_next_form(&p, &len)) != NULL) {
+		if (len == key_len && memcmp(start, key, len) == 0)
+			continue;
+		size_t i;
+		for (i = 0; i < n; i++) {
+			if (seen_len[i] == len && memcmp(seen[i], start, len) == 0)
+				break;
+		}
+		if (i < n)
+			continue;
+		if (n == 0)
+			rs_cat(out, "<idx:infl>");
+		seen[n] = start;
+		seen_len[n++] = len;
+		rs_cat(out, "<idx:iform value=\"");
+		rs_cat_n(out, start, len);
+		rs_cat(out, "\"/>");
+	}
+	if (n > 0)
+		rs_cat(out, "</idx:infl>\n");
+}
+
+// 释义每行一段
+static void kindle_render(kindle_job_t* job)
+{
+	const char* p = rs_data_c(&job->rows);
+
+	rs_init_w_cap(&job->html, rs_len(&job->rows) * 2);
+	for (size_t i = 0; i < job->count; i++) {
+		const char* key = p;
+		size_t key_len = strlen(key);
+		const char* word = key + key_len + 1;
+		size_t word_len = strlen(word);
+		const char* forms = word + word_len + 1;
+		p = forms + strlen(forms) + 1;
+
+		rs_cat(&job->html, "<idx:entry name=\"default\" scriptable=\"yes\" spell=\"yes\">\n<idx:orth value=\"");
+		kindle_escape(&job->html, key, key_len);
+		rs_cat(&job->html, "\"><b>");
+		kindle_escape(&job->html, key, key_len);
+		rs_cat(&job->html, "</b>\n");
+		if (*forms)
+			kindle_render_forms(&job->html, key, key_len, forms);
+		rs_cat(&job->html, "</idx:orth>\n");
+
+		const char* line = word;
+		const char* end = word + word_len;
+		while (line < end) {
+			const char* eol = memchr(line, '\n', end - line);
+			if (eol == NULL)
+				eol = end;
+			if (eol > line) {
+				rs_cat(&job->html, "<p>");
+				kindle_escape(&job->html, line, eol - line);
+				rs_cat(&job->html, "</p>\n");
+			}
+			line = eol + 1;
+		}
+		rs_cat(&job->html, "</idx:entry>\n<hr/>\n");
+	}
+	rs_free(&job->rows);
+}
+
+static void* kindle_worker(void* arg)
+{
+	kindle_t* k = arg;
+
+	for (;;) {
+		pthread_mutex_lock(&k->lock);
+		while (k->todo == NULL && !k->closed)
+			pthread_cond_wait(&k->changed, &k->lock);
+		kindle_job_t* job = k->todo;
+		if (job) {
+			k->todo = job->next;
+			if (k->todo == NULL)
+				k->todo_tail = &k->todo;
+		}
+		pthread_mutex_unlock(&k->lock);
+		if (job == NULL)
+			break;
+
+		kindle_render(job);
+
+		pthread_mutex_lock(&k->lock);
+		k->done[job->seq % KINDLE_QUEUE_DEPTH] = job;
+		pthread_cond_broadcast(&k->changed);
+		pthread_mutex_unlock(&k->lock);
+	}
+	return NULL;
+}
+
+static FILE* kindle_open(kindle_t* k, size_t index)
+{
+	char path[KINDLE_MAX_PATH];
+	snprintf(path, sizeof(path), "%s/content%zu.html", k->dir, index);
+	FILE* f = fopen(path, "wb");
+	if (f == NULL) {
+		fprintf(stderr, "error: Can't open %s: %s\n", path, strerror(errno));
+		return NULL;
+	}
+	fputs(KINDLE_HTML_HEADER, f);
+	return f;
+}
+
+static int kindle_close(FILE* f)
+{
+	fputs(KINDLE_HTML_FOOTER, f);
+	return fclose(f);
+}
+
+// 按顺序写入渲染完成的任务, 每 KINDLE_FILE_JOBS 个任务换一个文件
+static void* kindle_writer(void* arg)
+{
+	kindle_t* k = arg;
+	FILE* f = NULL;
+
+	for (size_t next = 0;; next++) {
+		pthread_mutex_lock(&k->lock);
+		while (k->done[next % KINDLE_QUEUE_DEPTH] == NULL && !(k->closed && next == k->jobs))
+			pthread_cond_wait(&k->changed, &k->lock);
+		kindle_job_t* job = k->done[next % KINDLE_QUEUE_DEPTH];
+		k->done[next % KINDLE_QUEUE_DEPTH] = NULL;
+		if (job)
+			k->in_flight--;
+		pthread_cond_broadcast(&k->changed);
+		pthread_mutex_unlock(&k->lock);
+		if (job == NULL)
+			break;
+
+		if (next % KINDLE_FILE_JOBS == 0 && !k->failed) {
+			if (f && kindle_close(f))
+				k->failed = 1;
+			f = kindle_open(k, k->files++);
+			if (f == NULL)
+				k->failed = 1;
+		}
+		if (f && fwrite(rs_data_c(&job->html), 1, rs_len(&job->html), f) != rs_len(&job->html))
+			k->failed = 1;
+		rs_free(&job->html);
+		free(job);
+	}
+	if (f && kindle_close(f))
+		k->failed = 1;
+	return NULL;
+}
+
+static void kindle_push(kindle_t* k, kindle_job_t* job)
+{
+	pthread_mutex_lock(&k->lock);
+	// 在途任务过多时等待写入线程
+	while (k->in_flight >= KINDLE_QUEUE_DEPTH)
+		pthread_cond_wait(&k->changed, &k->lock);
+	job->seq = k->jobs++;
+	job->next = NULL;
+	*k->todo_tail = job;
+	k->todo_tail = &job->next;
+	k->in_flight++;
+	pthread_cond_broadcast(&k->changed);
+	pthread_mutex_unlock(&k->lock);
+}
+
+static int kindle_opf(kindle_t* k)
+{
+	char path[KINDLE_MAX_PATH];
+	snprintf(path, sizeof(path), "%s/youdao.opf", k->dir);
+	FILE* f = fopen(path, "wb");
+	if (f == NULL) {
+		fprintf(stderr, "error: Can't open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	fputs("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+	      "<package version=\"2.0\" xmlns=\"http://www.idpf.org/2007/opf\" unique-identifier=\"BookId\">\n"
+	      "<metadata>\n"
+	      "<dc-metadata xmlns:dc=\"http://purl.org/dc/elements/1.1/\">\n"
+	      "<dc:title>Youdao</dc:title>\n"
+	      "<dc:language>en</dc:language>\n"
+	      "<dc:identifier id=\"BookId\">youdao</dc:identifier>\n"
+	      "</dc-metadata>\n"
+	      "<x-metadata>\n"
+	      "<DictionaryInLanguage>en</DictionaryInLanguage>\n"
+	      "<DictionaryOutLanguage>zh</DictionaryOutLanguage>\n"
+	      "<DefaultLookupIndex>default</DefaultLookupIndex>\n"
+	      "</x-metadata>\n"
+	      "</metadata>\n"
+	      "<manifest>\n", f);
+	for (size_t i = 0; i < k->files; i++)
+		fprintf(f, "<item id=\"content%zu\" href=\"content%zu.html\" media-type=\"application/xhtml+xml\"/>\n", i, i);
+	fputs("</manifest>\n<spine>\n", f);
+	for (size_t i = 0; i < k->files; i++)
+		fprintf(f, "<itemref idref=\"content%zu\"/>\n", i);
+	fputs("</spine>\n</package>\n", f);
+	return fclose(f) ? -1 : 0;
+}
+
+// 导出到目录 dir, 返回词条数, 失败返回 -1
+static long kindle_export(sqlite3* db, const char* dir, int threads)
+{
+	sqlite3_stmt* s;
+	kindle_t k;
+	long count = 0;
+
+	if (export_mkdir(dir) && errno != EEXIST) {
+		fprintf(stderr, "error: Can't create %s: %s\n", dir, strerror(errno));
+		return -1;
+	}
+	if (sqlite3_prepare_v2(db, SQL_KINDLE_ROWS, -1, &s, NULL)) {
+		fprintf(stderr, "error: Prepare stmt %s failed, %s\n", SQL_KINDLE_ROWS, sqlite3_errmsg(db));
+		return -1;
+	}
+	if (threads <= 0)
+		threads = KINDLE_THREADS;
+
+	memset(&k, 0, sizeof(k));
+	atomic_init(&k.failed, 0);
+	pthread_mutex_init(&k.lock, NULL);
+	pthread_cond_init(&k.changed, NULL);
+	k.todo_tail = &k.todo;
+	k.dir = dir;
+
+	pthread_t workers[threads];
+	pthread_t writer;
+	int started = 0;
+	while (started < threads && pthread_create(&workers[started], NULL, kindle_worker, &k) == 0)
+		started++;
+	// 少启动几个渲染线程也能完成, 一个都没有或没有写入线程时放弃
+	if (started == 0 || pthread_create(&writer, NULL, kindle_writer, &k)) {
+		fprintf(stderr, "error: Can't start export threads\n");
+		pthread_mutex_lock(&k.lock);
+		k.closed = 1;
+		pthread_cond_broadcast(&k.changed);
+		pthread_mutex_unlock(&k.lock);
+		for (int i = 0; i < started; i++)
+			pthread_join(workers[i], NULL);
+		sqlite3_finalize(s);
+		pthread_mutex_destroy(&k.lock);
+		pthread_cond_destroy(&k.changed);
+		return -1;
+	}
+
+	kindle_job_t* job = NULL;
+	int rc;
+	while ((rc = sqlite3_step(s)) == SQLITE_ROW) {
+		const char* key = (const char*)sqlite3_column_text(s, 0);
+		size_t key_len = sqlite3_column_bytes(s, 0);
+		const char* word = (const char*)sqlite3_column_text(s, 1);
+		size_t word_len = sqlite3_column_bytes(s, 1);
+		const char* forms = (const char*)sqlite3_column_text(s, 2);
+		size_t forms_len = sqlite3_column_bytes(s, 2);
+
+		if (key_len == 0)
+			continue;
+		if (job == NULL) {
+			job = calloc(1, sizeof(kindle_job_t));
+			rs_init(&job->rows);
+		}
+		rs_cat_n(&job->rows, key, key_len + 1);
+		rs_cat_n(&job->rows, word, word_len + 1);
+		rs_cat_n(&job->rows, forms ? forms : "", forms_len + 1);
+		count++;
+		if (++job->count == KINDLE_JOB_ROWS) {
+			kindle_push(&k, job);
+			job = NULL;
+		}
+	}
+	if (job)
+		kindle_push(&k, job);
+	// SQLITE_BUSY 等错误也会结束循环, 不能把不完整的词典当作成功
+	if (rc != SQLITE_DONE) {
+		fprintf(stderr, "error: Read dic failed (%d), %s\n", rc, sqlite3_errmsg(db));
+		k.failed = 1;
+	}
+	sqlite3_finalize(s);
+
+	pthread_mutex_lock(&k.lock);
+	k.closed = 1;
+	pthread_cond_broadcast(&k.changed);
+	pthread_mutex_unlock(&k.lock);
+	for (int i = 0; i < started; i++)
+		pthread_join(workers[i], NULL);
+	pthread_join(writer, NULL);
+
+	if (!k.failed && kindle_opf(&k))
+		k.failed = 1;
+	pthread_mutex_destroy(&k.lock);
+	pthread_cond_destroy(&k.changed);
+	return k.failed ? -1 : count;
+}
+
+#endif
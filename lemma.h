@@ -0,0 +1,200 @@
+#ifndef LEMMA_H__
+#define LEMMA_H__
+
+/*
+ * Rule and exception based English lemmatizer.
+ *
+ * Irregular forms are looked up in a sorted exception table. Regular forms
+ * are stripped by suffix rules, each producing candidate lemmas in order of
+ * likelihood; the first candidate the caller accepts wins (collect takes a
+ * word seen in the book at least as often as the form). A word no candidate
+ * matches is kept as is, so an unknown rule hit never invents a word.
+ * Agent nouns and comparatives share -er/-est (letter, corner, forest), so
+ * only the -ier/-iest forms are stripped.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LEMMA_MAX_WORD 64
+// 规则得到的原形和 -ed, -ing 的词干至少这么长, 避免 "as" -> "a", thing -> the 之类
+#define LEMMA_MIN_LENGTH 3
+
+// 返回非 0 表示 word 是已知的单词
+typedef int (*lemma_known_fn)(const char* word, void* ctx);
+
+typedef struct lemma_exception {
+	const char* form;
+	const char* lemma;
+} lemma_exception_t;
+
+// 不规则变化, 按 form 排序以便二分查找. 有常见独立词义的词形 (found, left, saw 等) 不在表中
+static const lemma_exception_t lemma_exceptions[] = {
+	{ "ageing", "age" }, { "agreeing", "agree" }, { "alumni", "alumnus" }, { "am", "be" },
+	{ "analyses", "analysis" }, { "appendices", "appendix" }, { "are", "be" }, { "arisen", "arise" },
+	{ "arose", "arise" }, { "ate", "eat" }, { "awoke", "awake" }, { "awoken", "awake" },
+	{ "bade", "bid" }, { "beaten", "beat" }, { "became", "become" }, { "been", "be" },
+	{ "began", "begin" }, { "begot", "beget" }, { "begun", "begin" }, { "beheld", "behold" },
+	{ "bent", "bend" }, { "besought", "beseech" }, { "bestrode", "bestride" }, { "bidden", "bid" },
+	{ "bitten", "bite" }, { "bled", "bleed" }, { "blew", "blow" }, { "blown", "blow" },
+	{ "bought", "buy" }, { "bred", "breed" }, { "broke", "break" }, { "broken", "break" },
+	{ "brought", "bring" }, { "built", "build" }, { "burnt", "burn" }, { "cacti", "cactus" },
+	{ "calves", "calf" }, { "came", "come" }, { "canoeing", "canoe" }, { "caught", "catch" },
+	{ "children", "child" }, { "chose", "choose" }, { "chosen", "choose" }, { "clung", "cling" },
+	{ "crept", "creep" }, { "crises", "crisis" }, { "criteria", "criterion" }, { "dealt", "deal" },
+	{ "did", "do" }, { "does", "do" }, { "done", "do" }, { "drank", "drink" }, { "drawn", "draw" },
+	{ "dreamt", "dream" }, { "drew", "draw" }, { "driven", "drive" }, { "drove", "drive" },
+	{ "drunk", "drink" }, { "dug", "dig" }, { "dwarves", "dwarf" }, { "dwelt", "dwell" },
+	{ "dying", "die" }, { "eaten", "eat" }, { "echoes", "echo" }, { "elves", "elf" },
+	{ "fed", "feed" }, { "feet", "foot" }, { "fled", "flee" }, { "fleeing", "flee" },
+	{ "flew", "fly" }, { "flies", "fly" }, { "flung", "fling" }, { "forbade", "forbid" },
+	{ "forbidden", "forbid" }, { "forgave", "forgive" }, { "forgiven", "forgive" },
+	{ "forgot", "forget" }, { "forgotten", "forget" }, { "forsaken", "forsake" },
+	{ "forsook", "forsake" }, { "fought", "fight" }, { "freeing", "free" }, { "froze", "freeze" },
+	{ "frozen", "freeze" }, { "fungi", "fungus" }, { "gave", "give" }, { "geese", "goose" },
+	{ "given", "give" }, { "goes", "go" }, { "gone", "go" }, { "got", "get" }, { "gotten", "get" },
+	{ "grew", "grow" }, { "grown", "grow" }, { "had", "have" }, { "halves", "half" },
+	{ "has", "have" }, { "heard", "hear" }, { "held", "hold" }, { "heroes", "hero" },
+	{ "hewn", "hew" }, { "hid", "hide" }, { "hidden", "hide" }, { "hoeing", "hoe" },
+	{ "hooves", "hoof" }, { "hung", "hang" }, { "hypotheses", "hypothesis" }, { "indices", "index" },
+	{ "is", "be" }, { "kept", "keep" }, { "knelt", "kneel" }, { "knew", "know" },
+	{ "knives", "knife" }, { "known", "know" }, { "laid", "lay" }, { "lain", "lie" },
+	{ "leapt", "leap" }, { "learnt", "learn" }, { "led", "lead" }, { "lent", "lend" },
+	{ "lice", "louse" }, { "lit", "light" }, { "lives", "life" }, { "loaves", "loaf" },
+	{ "lost", "lose" }, { "lying", "lie" }, { "made", "make" }, { "matrices", "matrix" },
+	{ "meant", "mean" }, { "men", "man" }, { "met", "meet" }, { "mice", "mouse" },
+	{ "mistaken", "mistake" }, { "mistook", "mistake" }, { "mown", "mow" }, { "nuclei", "nucleus" },
+	{ "outdid", "outdo" }, { "outgrew", "outgrow" }, { "overcame", "overcome" },
+	{ "overtook", "overtake" }, { "oxen", "ox" }, { "paid", "pay" }, { "partook", "partake" },
+	{ "phenomena", "phenomenon" }, { "potatoes", "potato" }, { "radii", "radius" }, { "ran", "run" },
+	{ "rang", "ring" }, { "ridden", "ride" }, { "risen", "rise" }, { "rode", "ride" },
+	{ "rung", "ring" }, { "said", "say" }, { "sang", "sing" }, { "sank", "sink" },
+	{ "seeing", "see" }, { "seen", "see" }, { "selves", "self" }, { "sent", "send" },
+	{ "sewn", "sew" }, { "shaken", "shake" }, { "shelves", "shelf" }, { "shod", "shoe" },
+	{ "shone", "shine" }, { "shook", "shake" }, { "shorn", "shear" }, { "shot", "shoot" },
+	{ "shown", "show" }, { "shrank", "shrink" }, { "shrunk", "shrink" }, { "singeing", "singe" },
+	{ "slain", "slay" }, { "slept", "sleep" }, { "slid", "slide" }, { "slung", "sling" },
+	{ "slunk", "slink" }, { "smelt", "smell" }, { "smitten", "smite" }, { "smote", "smite" },
+	{ "sold", "sell" }, { "sought", "seek" }, { "sown", "sow" }, { "spat", "spit" },
+	{ "sped", "speed" }, { "spelt", "spell" }, { "spent", "spend" }, { "spilt", "spill" },
+	{ "spoke", "speak" }, { "spoken", "speak" }, { "sprang", "spring" }, { "sprung", "spring" },
+	{ "spun", "spin" }, { "stank", "stink" }, { "stimuli", "stimulus" }, { "stole", "steal" },
+	{ "stolen", "steal" }, { "stood", "stand" }, { "strewn", "strew" }, { "stridden", "stride" },
+	{ "striven", "strive" }, { "strode", "stride" }, { "strove", "strive" }, { "struck", "strike" },
+	{ "stuck", "stick" }, { "stung", "sting" }, { "sung", "sing" }, { "sunk", "sink" },
+	{ "swam", "swim" }, { "swept", "sweep" }, { "swollen", "swell" }, { "swore", "swear" },
+	{ "sworn", "swear" }, { "swum", "swim" }, { "swung", "swing" }, { "taken", "take" },
+	{ "taught", "teach" }, { "teeth", "tooth" }, { "theses", "thesis" }, { "thieves", "thief" },
+	{ "thought", "think" }, { "threw", "throw" }, { "thrived", "thrive" }, { "throve", "thrive" },
+	{ "thrown", "throw" }, { "told", "tell" }, { "tomatoes", "tomato" }, { "took", "take" },
+	{ "tore", "tear" }, { "torn", "tear" }, { "trod", "tread" }, { "trodden", "tread" },
+	{ "tying", "tie" }, { "undergone", "undergo" }, { "understood", "understand" },
+	{ "undertook", "undertake" }, { "underwent", "undergo" }, { "upheld", "uphold" },
+	{ "vetoes", "veto" }, { "vying", "vie" }, { "was", "be" }, { "went", "go" }, { "wept", "weep" },
+	{ "were", "be" }, { "withdrawn", "withdraw" }, { "withdrew", "withdraw" }, { "wives", "wife" },
+	{ "woke", "wake" }, { "woken", "wake" }, { "wolves", "wolf" }, { "women", "woman" },
+	{ "won", "win" }, { "wore", "wear" }, { "worn", "wear" }, { "wove", "weave" },
+	{ "woven", "weave" }, { "written", "write" }, { "wrote", "write" }, { "wrung", "wring" },
+};
+
+// 看起来是词形但通常是独立单词, 原形又很常见的, 按字母排序
+static const char* const lemma_keep[] = { "evening", "morning", "news", "wedding" };
+
+typedef struct lemma_rule {
+	const char* suffix;
+	// NULL 表示动词后缀 -ed, -ing, 需要处理双写和词尾 e
+	const char* replace;
+} lemma_rule_t;
+
+// 按顺序尝试, 同一个单词可能匹配多条规则
+static const lemma_rule_t lemma_rules[] = {
+	{ "sses", "ss" }, { "ies", "y" }, { "ies", "ie" }, { "ves", "f" }, { "ves", "fe" },
+	{ "xes", "x" }, { "zes", "z" }, { "ches", "ch" }, { "shes", "sh" }, { "oes", "o" },
+	{ "ses", "s" }, { "s", "" },
+	{ "ied", "y" }, { "ed", NULL },
+	{ "ing", NULL },
+	{ "iest", "y" }, { "ier", "y" },
+};
+
+static int lemma_compare(const void* key, const void* item)
+{
+	return strcmp(key, ((const lemma_exception_t*)item)->form);
+}
+
+static int lemma_keep_compare(const void* key, const void* item)
+{
+	return strcmp(key, *(const char* const*)item);
+}
+
+static inline int lemma_vowel(char c)
+{
+	return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u';
+}
+
+// 写入 stem[0, len) + tail, 已知时返回 1
+static int lemma_try(char* out, const char* stem, size_t len, const char* tail,
+                     lemma_known_fn known, void* ctx)
+{
+	size_t tail_len = strlen(tail);
+	if (len + tail_len < LEMMA_MIN_LENGTH || len + tail_len >= LEMMA_MAX_WORD)
+		return 0;
+	memcpy(out, stem, len);
+	memcpy(out + len, tail, tail_len + 1);
+	return known(out, ctx);
+}
+
+// 去掉 -ed, -ing 后的词干, 太短的词干 (seed, shed, being) 不还原
+static int lemma_stem(char* out, const char* stem, size_t len, lemma_known_fn known, void* ctx)
+{
+	if (len < LEMMA_MIN_LENGTH)
+		return 0;
+	char last = stem[len - 1];
+	// 双写的辅音: running -> run, 但 added -> add 要先试不去掉的形式
+	if (last == stem[len - 2] && !lemma_vowel(last)) {
+		return lemma_try(out, stem, len, "", known, ctx) ||
+		       lemma_try(out, stem, len - 1, "", known, ctx);
+	}
+	// 辅音-元音-辅音结尾时更可能是去掉了 e: hoped -> hope, 否则 walked -> walk
+	int cvc = len >= 3 && !lemma_vowel(last) && last != 'w' && last != 'x' && last != 'y' &&
+	          lemma_vowel(stem[len - 2]) && !lemma_vowel(stem[len - 3]);
+	if (cvc)
+		return lemma_try(out, stem, len, "e", known, ctx) || lemma_try(out, stem, len, "", known, ctx);
+	return lemma_try(out, stem, len, "", known, ctx) || lemma_try(out, stem, len, "e", known, ctx);
+}
+
+// 把 word 的原形写入 out (至少 LEMMA_MAX_WORD 字节). 找到不同于 word 的原形时返回 1
+static int lemmatize(const char* word, char* out, lemma_known_fn known, void* ctx)
+{
+	size_t len = strlen(word);
+	if (len >= LEMMA_MAX_WORD)
+		return 0;
+
+	const lemma_exception_t* e = bsearch(word, lemma_exceptions,
+	                                     sizeof(lemma_exceptions) / sizeof(lemma_exceptions[0]),
+	                                     sizeof(lemma_exception_t), lemma_compare);
+	if (e) {
+		strcpy(out, e->lemma);
+		return 1;
+	}
+	if (bsearch(word, lemma_keep, sizeof(lemma_keep) / sizeof(lemma_keep[0]), sizeof(lemma_keep[0]),
+	            lemma_keep_compare))
+		return 0;
+
+	for (size_t i = 0; i < sizeof(lemma_rules) / sizeof(lemma_rules[0]); i++) {
+		const lemma_rule_t* r = &lemma_rules[i];
+		size_t suffix_len = strlen(r->suffix);
+		if (len <= suffix_len || memcmp(word + len - suffix_len, r->suffix, suffix_len) != 0)
+			continue;
+		size_t stem_len = len - suffix_len;
+		// -s 不处理 -ss, -us, -is: glass, bus, this
+		if (suffix_len == 1 && (word[stem_len - 1] == 's' || word[stem_len - 1] == 'u' || word[stem_len - 1] == 'i'))
+			continue;
+		if (r->replace ? lemma_try(out, word, stem_len, r->replace, known, ctx)
+		               : lemma_stem(out, word, stem_len, known, ctx))
+			return 1;
+	}
+	return 0;
+}
+
+#endif
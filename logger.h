@@ -0,0 +1,539 @@
+#ifndef LOGGER_H__
+#define LOGGER_H__
+
+/*
+ * Asynchronous logger behind the log_* macros of shared.h.
+ *
+ * A log call does not format anything. It walks the format string once,
+ * copies the arguments (and the bytes of every %s) into a record and
+ * appends the record to the calling thread's own ring buffer: a
+ * single-producer single-consumer ring, so the hot path takes no lock and
+ * never blocks. When the ring is full the record is dropped and counted.
+ *
+ * A drain thread takes records from all rings in sequence order, formats
+ * them with the same format strings and writes whole batches to stdout.
+ * logger_stop() (registered with atexit) drains what is left and reports
+ * drops. Before logger_start(), and for levels below the runtime level, log
+ * calls print synchronously or return at once.
+ */
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(_WIN32)
+#    include <windows.h>
+#    define log_sleep_ms(ms) Sleep(ms)
+#else
+#    include <time.h>
+#    define log_sleep_ms(ms) nanosleep(&(struct timespec){ 0, (ms)*1000000L }, NULL)
+#endif
+
+#define LOG_LEVEL_DBG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERR 3
+#define LOG_LEVEL_FATAL 4
+
+// 每个线程的环形缓冲区大小, 必须是 2 的幂
+#define LOG_RING_SIZE (1 << 16)
+#define LOG_MAX_RECORD 2048
+#define LOG_MAX_LINE 4096
+#define LOG_CACHE_LINE 64
+
+typedef struct log_ring {
+	struct log_ring* next;
+	// 生产者写入的位置
+	atomic_size_t head;
+	char pad1[LOG_CACHE_LINE - sizeof(atomic_size_t)];
+	// 消费者读取的位置
+	atomic_size_t tail;
+	char pad2[LOG_CACHE_LINE - sizeof(atomic_size_t)];
+	atomic_uint_fast64_t dropped;
+	unsigned char buf[LOG_RING_SIZE];
+} log_ring_t;
+
+typedef struct log_record {
+	uint32_t len;
+	uint32_t level;
+	uint64_t seq;
+	const char* tag;
+	const char* format;
+} log_record_t;
+
+typedef struct logger {
+	_Atomic(log_ring_t*) rings;
+	atomic_int level;
+	atomic_int running;
+	atomic_int stop;
+	atomic_uint_fast64_t seq;
+	pthread_t thread;
+} logger_t;
+
+static logger_t s_logger;
+
+static inline log_ring_t* log_ring(void)
+{
+	static _Thread_local log_ring_t* ring;
+	if (ring == NULL) {
+		log_ring_t* r = calloc(1, sizeof(log_ring_t));
+		if (r == NULL)
+			return NULL;
+		r->next = atomic_load(&s_logger.rings);
+		while (!atomic_compare_exchange_weak(&s_logger.rings, &r->next, r))
+			;
+		ring = r;
+	}
+	return ring;
+}
+
+static inline int log_flag(char c)
+{
+	return c == '-' || c == '+' || c == ' ' || c == '#' || c == '0';
+}
+
+static inline int log_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+// 按格式字符串复制参数: 整数和指针 8 字节, 浮点数 double, 字符串为 u32 长度加内容和 \0
+static size_t log_pack(unsigned char* out, size_t cap, const char* format, va_list ap)
+{
+	size_t n = 0;
+	const char* p = format;
+
+#define LOG_PUT(v)                               \
+	do {                                         \
+		if (n + sizeof(v) <= cap) {              \
+			memcpy(out + n, &(v), sizeof(v));    \
+			n += sizeof(v);                      \
+		}                                        \
+	} while (0)
+
+	while ((p = strchr(p, '%')) != NULL) {
+		p++;
+		if (*p == '%') {
+			p++;
+			continue;
+		}
+		while (log_flag(*p))
+			p++;
+		if (*p == '*') {
+			int64_t v = va_arg(ap, int);
+			LOG_PUT(v);
+			p++;
+		}
+		while (log_digit(*p))
+			p++;
+		// %.*s 常用于没有 \0 结尾的缓冲区, 字符串只能读取精度以内的字节
+		int prec = -1;
+		if (*p == '.') {
+			p++;
+			prec = 0;
+			if (*p == '*') {
+				int64_t v = va_arg(ap, int);
+				LOG_PUT(v);
+				prec = v < 0 ? -1 : (int)v;
+				p++;
+			}
+			for (; log_digit(*p); p++)
+				prec = prec < (1 << 24) ? prec * 10 + (*p - '0') : prec;
+		}
+		char len = 0, len2 = 0;
+		if (*p == 'h' || *p == 'l' || *p == 'z' || *p == 'j' || *p == 't' || *p == 'L') {
+			len = *p++;
+			if ((len == 'h' || len == 'l') && *p == len)
+				len2 = *p++;
+		}
+		switch (*p++) {
+		case 'd':
+		case 'i': {
+			int64_t v;
+			if (len == 'h')
+				v = len2 ? (signed char)va_arg(ap, int) : (short)va_arg(ap, int);
+			else if (len == 'l')
+				v = len2 ? va_arg(ap, long long) : va_arg(ap, long);
+			else if (len == 'z')
+				v = (int64_t)va_arg(ap, size_t);
+			else if (len == 'j')
+				v = va_arg(ap, intmax_t);
+			else if (len == 't')
+				v = va_arg(ap, ptrdiff_t);
+			else
+				v = va_arg(ap, int);
+			LOG_PUT(v);
+			break;
+		}
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X': {
+			uint64_t v;
+			if (len == 'h')
+				v = len2 ? (unsigned char)va_arg(ap, unsigned) : (unsigned short)va_arg(ap, unsigned);
+			else if (len == 'l')
+				v = len2 ? va_arg(ap, unsigned long long) : va_arg(ap, unsigned long);
+			else if (len == 'z')
+				v = va_arg(ap, size_t);
+			else if (len == 'j')
+				v = va_arg(ap, uintmax_t);
+			else if (len == 't')
+				v = (uint64_t)va_arg(ap, ptrdiff_t);
+			else
+				v = va_arg(ap, unsigned);
+			LOG_PUT(v);
+			break;
+		}
+		case 'c': {
+			int64_t v = va_arg(ap, int);
+			LOG_PUT(v);
+			break;
+		}
+		case 'p': {
+			uint64_t v = (uintptr_t)va_arg(ap, void*);
+			LOG_PUT(v);
+			break;
+		}
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A': {
+			double v = len == 'L' ? (double)va_arg(ap, long double) : va_arg(ap, double);
+			LOG_PUT(v);
+			break;
+		}
+		case 's': {
+			const char* s = va_arg(ap, const char*);
+			if (s == NULL)
+				s = "(null)";
+			uint32_t l = (uint32_t)(prec >= 0 ? strnlen(s, (size_t)prec) : strlen(s));
+			// 放不下时截断
+			if (n + sizeof(l) + l + 1 > cap)
+				l = n + sizeof(l) + 1 < cap ? (uint32_t)(cap - n - sizeof(l) - 1) : 0;
+			if (n + sizeof(l) + l + 1 <= cap) {
+				memcpy(out + n, &l, sizeof(l));
+				memcpy(out + n + sizeof(l), s, l);
+				out[n + sizeof(l) + l] = 0;
+				n += sizeof(l) + l + 1;
+			}
+			break;
+		}
+		case 'n':
+			(void)va_arg(ap, int*);
+			break;
+		default:
+			// 不认识的转换, 后面的参数无法解析
+			return n;
+		}
+	}
+#undef LOG_PUT
+	return n;
+}
+
+// 按 log_pack 的布局格式化记录, 返回写入 line 的长度
+static size_t log_format(char* line, size_t cap, const log_record_t* rec, const unsigned char* args, size_t args_len)
+{
+	size_t n = 0, a = 0;
+	const char* p = rec->format;
+	char spec[64];
+
+#define LOG_GET(v)                                   \
+	do {                                             \
+		memset(&(v), 0, sizeof(v));                  \
+		if (a + sizeof(v) <= args_len) {             \
+			memcpy(&(v), args + a, sizeof(v));       \
+			a += sizeof(v);                          \
+		}                                            \
+	} while (0)
+#define LOG_APPEND(...)                                          \
+	do {                                                         \
+		if (n < cap) {                                           \
+			int w = snprintf(line + n, cap - n, __VA_ARGS__);    \
+			if (w > 0)                                           \
+				n += (size_t)w < cap - n ? (size_t)w : cap - n - 1; \
+		}                                                        \
+	} while (0)
+
+	LOG_APPEND("%s ", rec->tag);
+	for (;;) {
+		const char* pct = strchr(p, '%');
+		size_t lit = pct ? (size_t)(pct - p) : strlen(p);
+		if (lit > 0)
+			LOG_APPEND("%.*s", (int)lit, p);
+		if (pct == NULL)
+			break;
+		p = pct + 1;
+		if (*p == '%') {
+			LOG_APPEND("%%");
+			p++;
+			continue;
+		}
+
+		// 重新拼出转换说明, '*' 换成记录的值, 长度修饰统一为 ll
+		size_t s = 0;
+		spec[s++] = '%';
+		while (log_flag(*p) && s < 8)
+			spec[s++] = *p++;
+		if (*p == '*') {
+			int64_t v;
+			LOG_GET(v);
+			s += snprintf(spec + s, sizeof(spec) - s, "%d", (int)v);
+			p++;
+		}
+		while (log_digit(*p) && s < 16)
+			spec[s++] = *p++;
+		if (*p == '.') {
+			spec[s++] = *p++;
+			if (*p == '*') {
+				int64_t v;
+				LOG_GET(v);
+				s += snprintf(spec + s, sizeof(spec) - s, "%d", (int)v);
+				p++;
+			}
+			while (log_digit(*p) && s < 24)
+				spec[s++] = *p++;
+		}
+		if (*p == 'h' || *p == 'l' || *p == 'z' || *p == 'j' || *p == 't' || *p == 'L') {
+			char len = *p++;
+			if ((len == 'h' || len == 'l') && *p == len)
+				p++;
+		}
+		char conv = *p++;
+		switch (conv) {
+		case 'd':
+		case 'i': {
+			int64_t v;
+			LOG_GET(v);
+			spec[s++] = 'l';
+			spec[s++] = 'l';
+			spec[s++] = conv;
+			spec[s] = 0;
+			LOG_APPEND(spec, (long long)v);
+			break;
+		}
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X': {
+			uint64_t v;
+			LOG_GET(v);
+			spec[s++] = 'l';
+			spec[s++] = 'l';
+			spec[s++] = conv;
+			spec[s] = 0;
+			LOG_APPEND(spec, (unsigned long long)v);
+			break;
+		}
+		case 'c': {
+			int64_t v;
+			LOG_GET(v);
+			spec[s++] = conv;
+			spec[s] = 0;
+			LOG_APPEND(spec, (int)v);
+			break;
+		}
+		case 'p': {
+			uint64_t v;
+			LOG_GET(v);
+			spec[s++] = conv;
+			spec[s] = 0;
+			LOG_APPEND(spec, (void*)(uintptr_t)v);
+			break;
+		}
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A': {
+			double v;
+			LOG_GET(v);
+			spec[s++] = conv;
+			spec[s] = 0;
+			LOG_APPEND(spec, v);
+			break;
+		}
+		case 's': {
+			uint32_t l = 0;
+			LOG_GET(l);
+			const char* str = a + l + 1 <= args_len ? (const char*)args + a : "";
+			a += l + 1;
+			spec[s++] = conv;
+			spec[s] = 0;
+			LOG_APPEND(spec, str);
+			break;
+		}
+		case 'n':
+			break;
+		default:
+			LOG_APPEND("%s", pct);
+			p = pct + strlen(pct);
+			break;
+		}
+	}
+	if (n < cap - 1)
+		line[n++] = '\n';
+	else
+		line[cap - 2] = '\n';
+#undef LOG_GET
+#undef LOG_APPEND
+	return n;
+}
+
+static inline void log_ring_copy(unsigned char* dst, const log_ring_t* r, size_t pos, size_t len)
+{
+	size_t off = pos & (LOG_RING_SIZE - 1);
+	size_t first = LOG_RING_SIZE - off < len ? LOG_RING_SIZE - off : len;
+	memcpy(dst, r->buf + off, first);
+	memcpy(dst + first, r->buf, len - first);
+}
+
+static void log_write(int level, const char* tag, const char* format, ...)
+{
+	va_list ap;
+
+	if (level < atomic_load_explicit(&s_logger.level, memory_order_relaxed))
+		return;
+	va_start(ap, format);
+	if (!atomic_load_explicit(&s_logger.running, memory_order_acquire)) {
+		printf("%s ", tag);
+		vprintf(format, ap);
+		printf("\n");
+		va_end(ap);
+		return;
+	}
+
+	unsigned char rec[LOG_MAX_RECORD];
+	log_record_t h;
+	size_t len = sizeof(h) + log_pack(rec + sizeof(h), sizeof(rec) - sizeof(h), format, ap);
+	va_end(ap);
+	// 记录按 8 字节对齐
+	len = (len + 7) & ~(size_t)7;
+	h.len = (uint32_t)len;
+	h.level = (uint32_t)level;
+	h.seq = atomic_fetch_add_explicit(&s_logger.seq, 1, memory_order_relaxed);
+	h.tag = tag;
+	h.format = format;
+	memcpy(rec, &h, sizeof(h));
+
+	log_ring_t* r = log_ring();
+	if (r == NULL)
+		return;
+	size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+	if (LOG_RING_SIZE - (head - tail) < len) {
+		atomic_store_explicit(&r->dropped, atomic_load_explicit(&r->dropped, memory_order_relaxed) + 1,
+		                      memory_order_relaxed);
+		return;
+	}
+	size_t off = head & (LOG_RING_SIZE - 1);
+	size_t first = LOG_RING_SIZE - off < len ? LOG_RING_SIZE - off : len;
+	memcpy(r->buf + off, rec, first);
+	memcpy(r->buf, rec + first, len - first);
+	atomic_store_explicit(&r->head, head + len, memory_order_release);
+}
+
+// 按序号合并所有环形缓冲区, 格式化后整批写出. 返回处理的记录数
+static size_t log_drain(void)
+{
+	static char out[LOG_MAX_LINE * 16];
+	unsigned char rec[LOG_MAX_RECORD];
+	size_t count = 0, used = 0;
+
+	for (;;) {
+		log_ring_t* next = NULL;
+		log_record_t best;
+		for (log_ring_t* r = atomic_load(&s_logger.rings); r; r = r->next) {
+			size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+			if (atomic_load_explicit(&r->head, memory_order_acquire) == tail)
+				continue;
+			log_record_t h;
+			log_ring_copy((unsigned char*)&h, r, tail, sizeof(h));
+			if (next == NULL || h.seq < best.seq) {
+				next = r;
+				best = h;
+			}
+		}
+		if (next == NULL)
+			break;
+
+		size_t tail = atomic_load_explicit(&next->tail, memory_order_relaxed);
+		log_ring_copy(rec, next, tail, best.len);
+		atomic_store_explicit(&next->tail, tail + best.len, memory_order_release);
+
+		if (sizeof(out) - used < LOG_MAX_LINE) {
+			fwrite(out, 1, used, stdout);
+			used = 0;
+		}
+		used += log_format(out + used, LOG_MAX_LINE, &best, rec + sizeof(best), best.len - sizeof(best));
+		count++;
+	}
+	if (used > 0)
+		fwrite(out, 1, used, stdout);
+	if (count > 0)
+		fflush(stdout);
+	return count;
+}
+
+static void* log_run(void* arg)
+{
+	(void)arg;
+	while (!atomic_load(&s_logger.stop)) {
+		if (log_drain() == 0)
+			log_sleep_ms(1);
+	}
+	return NULL;
+}
+
+static uint64_t logger_dropped(void)
+{
+	uint64_t dropped = 0;
+	for (log_ring_t* r = atomic_load(&s_logger.rings); r; r = r->next)
+		dropped += atomic_load_explicit(&r->dropped, memory_order_relaxed);
+	return dropped;
+}
+
+// 停止后台线程并写出剩余的记录. 之后的日志同步打印
+static void logger_stop(void)
+{
+	if (!atomic_load(&s_logger.running))
+		return;
+	// 先让新的日志同步打印, 后台线程退出后再写出所有环形缓冲区中剩余的记录
+	atomic_store(&s_logger.running, 0);
+	atomic_store(&s_logger.stop, 1);
+	pthread_join(s_logger.thread, NULL);
+	log_drain();
+	uint64_t dropped = logger_dropped();
+	if (dropped > 0)
+		fprintf(stderr, "warning: Dropped %llu log messages\n", (unsigned long long)dropped);
+}
+
+// 启动后台线程, 低于 level 的日志不再记录. 退出时自动停止
+static int logger_start(int level)
+{
+	static int registered;
+	atomic_store(&s_logger.level, level);
+	atomic_store(&s_logger.stop, 0);
+	if (pthread_create(&s_logger.thread, NULL, log_run, NULL))
+		return -1;
+	atomic_store(&s_logger.running, 1);
+	if (!registered) {
+		registered = 1;
+		atexit(logger_stop);
+	}
+	return 0;
+}
+
+#endif
@@ -9,11 +9,40 @@
 #include <pthread.h>
 #include <stdbool.h>
 #include <time.h>
+#include <signal.h>
 #include <sqlite3.h>
+
+// 按子系统统计 cJSON 和 rapidstring 的内存分配, 编译时定义 ALLOC_ACCOUNTING=0 关闭
+#ifndef ALLOC_ACCOUNTING
+#    define ALLOC_ACCOUNTING 1
+#endif
+#if ALLOC_ACCOUNTING
+#    include "alloc.h"
+// 需要在第一次包含 rapidstring.h 之前定义
+#    define RS_MALLOC(n) alloc_malloc(ALLOC_RS, n)
+#    define RS_REALLOC(p, n) alloc_realloc(ALLOC_RS, p, n)
+#    define RS_FREE(p) alloc_free(p)
+#endif
+
 #include "tmd5/tmd5.h"
+#include "md5mb.h"
 #include "cJSON/cJSON.h"
 #include "http2.h"
 #include "lite-list.h"
+#include "mpsc.h"
+#include "image.h"
+#include "symspell.h"
+#include "lemma.h"
+#include "dict.h"
+#include "server.h"
+#include "rcu.h"
+#include "cache.h"
+#include "kindle.h"
+#include "stardict.h"
+#include "histo.h"
+#include "bench.h"
+#include "metrics.h"
+#include "trace.h"
 #include "rapidstring.h"
 #include "shared.h"
 
@@ -44,43 +73,178 @@
 #define DBNAME "youdao.db"
 #define SQL_CREATE_TABLE "CREATE TABLE IF NOT EXISTS \"dic\" ( \"key\" varchar , \"word\" varchar, \"learned\" INTEGER)"
 #define SQL_CREATE_INDEX "CREATE UNIQUE INDEX IF NOT EXISTS `key_UNIQUE` ON `dic` (`key` ASC)"
+// 以 key 为主键的聚簇表: 单词只存储一次, 查询只需要一次 B 树查找
+#define SQL_CREATE_TABLE_CLUSTERED "CREATE TABLE IF NOT EXISTS \"dic\" ( \"key\" varchar NOT NULL PRIMARY KEY, \"word\" varchar, \"learned\" INTEGER) WITHOUT ROWID"
+#define SQL_CLUSTERED "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'dic' AND sql LIKE '%WITHOUT ROWID%'"
+#define SQL_MIGRATE_CLUSTERED \
+	"CREATE TABLE \"dic_clustered\" ( \"key\" varchar NOT NULL PRIMARY KEY, \"word\" varchar, \"learned\" INTEGER) WITHOUT ROWID;" \
+	"INSERT OR IGNORE INTO dic_clustered SELECT key, word, learned FROM dic WHERE key IS NOT NULL ORDER BY key;" \
+	"DROP TABLE dic;" \
+	"ALTER TABLE dic_clustered RENAME TO dic;"
 #define SQL_QUERY "SELECT key FROM dic WHERE key = ?"
+#define SQL_DEFINITION "SELECT word FROM dic WHERE key = ?"
 #define SQL_INSERT "INSERT INTO dic VALUES(?,?,0)"
+#define SQL_IMPORT "INSERT OR IGNORE INTO dic VALUES(?,?,0)"
+#define SQL_KEYS "SELECT key FROM dic"
+#define SQL_DATA_VERSION "PRAGMA data_version"
+#define SQL_CREATE_INFLECTIONS "CREATE TABLE IF NOT EXISTS \"inflections\" ( \"key\" varchar NOT NULL, \"form\" varchar NOT NULL, PRIMARY KEY(\"key\", \"form\")) WITHOUT ROWID"
+#define SQL_INSERT_INFLECTION "INSERT OR IGNORE INTO inflections VALUES(?,?)"
+
+// 结构化的词条: 音标, 翻译, 基本释义, 网络释义, 词形变化
+#define SQL_CREATE_ENTRIES "CREATE TABLE IF NOT EXISTS \"entries\" ( \"id\" INTEGER PRIMARY KEY, \"key\" varchar NOT NULL UNIQUE, \"phonetic\" varchar, \"us_phonetic\" varchar, \"uk_phonetic\" varchar, \"translation\" varchar, \"speak_url\" varchar)"
+#define SQL_CREATE_SENSES "CREATE TABLE IF NOT EXISTS \"senses\" ( \"entry_id\" INTEGER NOT NULL REFERENCES entries(id) ON DELETE CASCADE, \"pos\" INTEGER, \"text\" varchar)"
+#define SQL_CREATE_WEB_PHRASES "CREATE TABLE IF NOT EXISTS \"web_phrases\" ( \"entry_id\" INTEGER NOT NULL REFERENCES entries(id) ON DELETE CASCADE, \"phrase\" varchar, \"meaning\" varchar)"
+#define SQL_CREATE_WORD_FORMS "CREATE TABLE IF NOT EXISTS \"word_forms\" ( \"entry_id\" INTEGER NOT NULL REFERENCES entries(id) ON DELETE CASCADE, \"name\" varchar, \"value\" varchar)"
+#define SQL_CREATE_ENTRIES_INDEX "CREATE INDEX IF NOT EXISTS `entries_us_phonetic` ON `entries` (`us_phonetic`) WHERE `us_phonetic` IS NOT NULL"
+#define SQL_CREATE_SENSES_INDEX "CREATE INDEX IF NOT EXISTS `senses_entry` ON `senses` (`entry_id`)"
+#define SQL_CREATE_WEB_PHRASES_INDEX "CREATE INDEX IF NOT EXISTS `web_phrases_entry` ON `web_phrases` (`entry_id`)"
+#define SQL_CREATE_WEB_PHRASES_PHRASE_INDEX "CREATE INDEX IF NOT EXISTS `web_phrases_phrase` ON `web_phrases` (`phrase`)"
+#define SQL_CREATE_WORD_FORMS_INDEX "CREATE INDEX IF NOT EXISTS `word_forms_entry` ON `word_forms` (`entry_id`)"
+#define SQL_CREATE_WORD_FORMS_VALUE_INDEX "CREATE INDEX IF NOT EXISTS `word_forms_value` ON `word_forms` (`value`, `name`)"
+#define SQL_INSERT_ENTRY "INSERT OR REPLACE INTO entries(key,phonetic,us_phonetic,uk_phonetic,translation,speak_url) VALUES(?,?,?,?,?,?)"
+#define SQL_INSERT_SENSE "INSERT INTO senses VALUES(?,?,?)"
+#define SQL_INSERT_WEB_PHRASE "INSERT INTO web_phrases VALUES(?,?,?)"
+#define SQL_INSERT_WORD_FORM "INSERT INTO word_forms VALUES(?,?,?)"
+
+// 写入批处理: 每 BATCH_ROWS 条记录或 BATCH_MS 毫秒提交一次事务,
+// 可通过环境变量 YOUDAO_BATCH_ROWS, YOUDAO_BATCH_MS 和 YOUDAO_SYNCHRONOUS 修改
+#define BATCH_ROWS 500
+#define BATCH_MS 2000
+#define DB_SYNCHRONOUS "NORMAL"
+
+// 写入线程队列的容量, 必须是 2 的幂. 队列满时生产者等待
+#define WRITER_QUEUE_SIZE 1024
+
+// sign_batch 每次在栈上准备的签名数
+#define SIGN_BATCH 64
+
+// NDJSON 导入: 解析线程数, 每次读取的块大小, 每个事务的记录数
+#define IMPORT_THREADS 4
+#define IMPORT_CHUNK_SIZE (1 << 22)
+#define IMPORT_BATCH_SIZE 100000
+#define IMPORT_QUEUE_DEPTH 16
+
+// 拼写纠正的最大编辑距离, 可通过环境变量 YOUDAO_SPELL_DISTANCE 修改, 0 为关闭.
+// 短单词的允许距离更小: 5 个字母以上才纠正 1 处, 9 个字母以上才纠正 2 处.
+// 默认关闭: horse 和 house, quiet 和 quite 这样只差一处的真实单词会被当作拼写错误跳过
+#define SPELL_DISTANCE 0
+
+// 单词还原为原形后再去重: 0 关闭, 1 合并词形变化, 2 合并并把书中出现的词形
+// 记录到 inflections 表, 供 Kindle 词典的 idx:infl 使用. 环境变量 YOUDAO_LEMMATIZE
+#define LEMMATIZE 1
+
+// 查询服务检查 dic 是否变化的间隔, 变化时在后台重建索引. 环境变量 YOUDAO_RELOAD_MS, 0 为不检查
+#define RELOAD_MS 2000
+
+// 释义缓存的容量 (字节), 环境变量 YOUDAO_CACHE_BYTES, 0 为不缓存
+#define CACHE_BYTES (8 << 20)
+
+// 运行时的日志级别 (0 DBG, 1 INFO, 2 WARN, 3 ERR), 环境变量 YOUDAO_LOG_LEVEL.
+// 查询, 导入和查询服务的日志由后台线程写出
+#define LOG_LEVEL_DEFAULT LOG_LEVEL_INFO
+
+// 查询和导入时在 127.0.0.1 上提供 Prometheus 格式的 /metrics, 环境变量 YOUDAO_METRICS_PORT, 0 为关闭
+#define METRICS_PORT 0
+
+// 记录每个单词在各阶段的 span, 退出时写入 TRACE_FILE, 用 chrome://tracing 或 Perfetto 打开.
+// 环境变量 YOUDAO_TRACE, 1 为开启
+#define TRACE 0
+#define TRACE_FILE "trace.json"
 
 #ifndef container_of
 #    define container_of(ptr, type, member) \
         ((type*)((char*)(ptr)-offsetof(type, member)))
 #endif
 
-static sqlite3_stmt* s_insert;
 static sqlite3_stmt* s_query;
+static sqlite3_stmt* s_definition;
+// 释义缓存 (define) 和存在检查的缓存分开, 存在检查写入的空值不会被当作释义返回
+static cache_t s_cache;
+static cache_t s_known;
 static sqlite3* db;
 
+// query() 各阶段的耗时, 退出时和收到 SIGUSR1 时打印
+enum { STAGE_DNS, STAGE_CONNECT, STAGE_SEND, STAGE_TTFB, STAGE_BODY, STAGE_PARSE, STAGE_INSERT, STAGES };
+static const char* const s_stage_names[STAGES] = { "dns", "connect", "send", "ttfb", "body", "parse", "insert" };
+static histo_registry_t s_histo;
+static volatile sig_atomic_t s_histo_dump;
+
+// 运行时指标, 启动时注册, 任何线程都可以更新
+static metrics_t s_metrics;
+static struct {
+	metric_t* tokenized;
+	metric_t* cache_hits;
+	metric_t* cache_misses;
+	metric_t* in_flight;
+	metric_t* bytes_received;
+	metric_t* api_errors;
+	metric_t* batch_rows;
+	metric_t* queue_depth;
+} s_m;
+// 关闭时 trace_begin/trace_end 只读取一个标志
+static trace_registry_t s_trace;
+
+static const uint64_t s_batch_bounds[] = { 1, 10, 100, 1000, 10000, 100000 };
+
+void on_histo_signal(int sig) {
+	(void)sig;
+	s_histo_dump = 1;
+}
+
 typedef struct word {
 	char* buf;
+	// 在书中出现的次数
+	size_t count;
+	// 合并到该单词的词形, 以 \0 分隔
+	rapidstring forms;
 	list_head_t list;
 } word_t;
-static const char HEX_ARRAY[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
-                                  'A', 'B', 'C', 'D', 'E', 'F'
-                                };
 
-int contains(list_head_t* list, const char* s) {
+word_t* contains(list_head_t* list, const char* s) {
 	word_t* pos;
 	list_for_each_entry(pos, list, list, word_t) {
 		if (strcmp(pos->buf, s) == 0)
-			return 1;
+			return pos;
 	}
-	return 0;
+	return NULL;
+}
+int exists_sql(sqlite3* db, const char* key, sqlite3_stmt* s, cache_t* cache);
+size_t setting(const char* name, size_t def);
+
+typedef struct known {
+	list_head_t* list;
+	// 词形出现的次数
+	size_t count;
+} known_t;
+
+// 原形在书中出现的次数不少于词形时才采用, 否则 morning -> morn, news -> new
+// 之类比原形更常见的单词会被并入不相关的词
+int known_word(const char* s, void* ctx) {
+	known_t* k = ctx;
+	word_t* word = contains(k->list, s);
+	return word != NULL && word->count >= k->count;
+}
+void add_form(word_t* word, const char* form) {
+	size_t len = strlen(form);
+	const char* p = rs_data_c(&word->forms);
+	const char* end = p + rs_len(&word->forms);
+	for (; p < end; p += strlen(p) + 1) {
+		if (strcmp(p, form) == 0)
+			return;
+	}
+	rs_cat_n(&word->forms, form, len + 1);
 }
 
-list_head_t* collect() {
+list_head_t* collect(const char* filename) {
 
 	// 初始化列表
 	static LIST_HEAD(word_list);
 	INIT_LIST_HEAD(&word_list);
+	int lemmatize_mode = (int)setting("YOUDAO_LEMMATIZE", LEMMATIZE);
+	char lemma[LEMMA_MAX_WORD];
 
 	// 加载文本文件
-	FILE* txt = fopen("./words/23.txt", "r");
+	FILE* txt = fopen(filename, "r");
 	if (!txt) {
 		return 0;
 	}
@@ -92,6 +256,7 @@ list_head_t* collect() {
 	char buf[len];
 	memset(buf, 0, len);
 
+	trace_begin(&s_trace, "tokenize", filename);
 	while ((c = fgetc(txt)) != EOF) {
 
 		if (isalpha(c) && i < len) {
@@ -107,12 +272,17 @@ list_head_t* collect() {
 			buf[0] = 0;
 			continue;
 		} else {
+			metric_add(s_m.tokenized, 1);
 			// 如果列表中不包括单词
-			if (!contains(&word_list, buf)) {
-				word_t* word = malloc(sizeof(word_t));
+			word_t* word = contains(&word_list, buf);
+			if (!word) {
+				word = malloc(sizeof(word_t));
 				word->buf = strdup(buf);
+				word->count = 0;
+				rs_init(&word->forms);
 				list_add_tail(&word->list, &word_list);
 			}
+			word->count++;
 			// 重设长度标记
 			// 清空单词内存块
 			i = 0;
@@ -120,9 +290,43 @@ list_head_t* collect() {
 		}
 	}
 	fclose(txt);
+	trace_end(&s_trace, "tokenize");
+
+	// 整本书计数后再还原词形, 已在数据库中的单词保持原样
+	word_t *pos, *tmp, *word;
+	list_for_each_entry_safe(pos, tmp, &word_list, list, word_t) {
+		known_t known = { &word_list, pos->count };
+		if (!lemmatize_mode || exists_sql(db, pos->buf, s_query, &s_known) == 1 ||
+		        !lemmatize(pos->buf, lemma, known_word, &known))
+			continue;
+		// 只有不规则变化的原形可能不在书中, 直接改为原形
+		if ((word = contains(&word_list, lemma)) == NULL) {
+			if (lemmatize_mode == 2)
+				add_form(pos, pos->buf);
+			free(pos->buf);
+			pos->buf = strdup(lemma);
+			continue;
+		}
+		if (lemmatize_mode == 2) {
+			add_form(word, pos->buf);
+			const char* f = rs_data_c(&pos->forms);
+			for (const char* p = f; p < f + rs_len(&pos->forms); p += strlen(p) + 1)
+				add_form(word, p);
+		}
+		list_del(&pos->list);
+		rs_free(&pos->forms);
+		free(pos->buf);
+		free(pos);
+	}
 	return &word_list;
 }
 
+size_t setting(const char* name, size_t def) {
+	const char* value = getenv(name);
+	if (value == NULL || *value == 0)
+		return def;
+	return (size_t)strtoull(value, NULL, 10);
+}
 sqlite3* database() {
 	sqlite3* db = { 0 };
 
@@ -131,22 +335,110 @@ sqlite3* database() {
 		printf("sqlite3_open_v2() failed.");
 		return NULL;
 	}
+	// 替换词条时级联删除其释义和词形
+	sqlite3_exec(db, "PRAGMA foreign_keys = ON", 0, 0, 0);
+
+	// WAL 模式下提交只需追加日志, 读取不会被写入阻塞
+	char* error;
+	rc = sqlite3_exec(db, "PRAGMA journal_mode = WAL", 0, 0, &error);
+	if (rc != SQLITE_OK) {
+		printf("sqlite3_exec() failed. %s\n", error);
+		sqlite3_free(error);
+	}
+
+	// OFF, NORMAL, FULL 或 EXTRA. WAL + NORMAL 在断电时可能丢失最后几个批次,
+	// 但数据库始终一致; 需要每个批次都持久化时使用 FULL
+	static const char* levels[] = { "OFF", "NORMAL", "FULL", "EXTRA" };
+	const char* synchronous = getenv("YOUDAO_SYNCHRONOUS");
+	const char* level = DB_SYNCHRONOUS;
+	for (size_t i = 0; synchronous && i < sizeof(levels) / sizeof(levels[0]); i++) {
+		if (strcasecmp(synchronous, levels[i]) == 0)
+			level = levels[i];
+	}
+	char pragma[64];
+	snprintf(pragma, sizeof(pragma), "PRAGMA synchronous = %s", level);
+	sqlite3_exec(db, pragma, 0, 0, 0);
 
 	return db;
 }
 
+int clustered(sqlite3* db) {
+	sqlite3_stmt* s;
+	if (sqlite3_prepare_v2(db, SQL_CLUSTERED, -1, &s, NULL))
+		return 0;
+	int rc = sqlite3_step(s) == SQLITE_ROW;
+	sqlite3_finalize(s);
+	return rc;
+}
 int table(sqlite3* db) {
+	static const char* sql[] = {
+		SQL_CREATE_ENTRIES,
+		SQL_CREATE_SENSES,
+		SQL_CREATE_WEB_PHRASES,
+		SQL_CREATE_WORD_FORMS,
+		SQL_CREATE_ENTRIES_INDEX,
+		SQL_CREATE_SENSES_INDEX,
+		SQL_CREATE_WEB_PHRASES_INDEX,
+		SQL_CREATE_WEB_PHRASES_PHRASE_INDEX,
+		SQL_CREATE_WORD_FORMS_INDEX,
+		SQL_CREATE_WORD_FORMS_VALUE_INDEX,
+		SQL_CREATE_INFLECTIONS,
+	};
 	char* error;
+	int rc = SQLITE_OK;
 
-	int rc = sqlite3_exec(db, SQL_CREATE_TABLE, 0, 0, &error);
+	// 新建的数据库在设置 YOUDAO_CLUSTERED=1 时使用聚簇表,
+	// 已有的数据库保持原来的结构, 使用 migrate 转换
+	rc = sqlite3_exec(db, setting("YOUDAO_CLUSTERED", 0) ? SQL_CREATE_TABLE_CLUSTERED : SQL_CREATE_TABLE, 0, 0, &error);
+	if (rc == SQLITE_OK && !clustered(db))
+		rc = sqlite3_exec(db, SQL_CREATE_INDEX, 0, 0, &error);
 	if (rc != SQLITE_OK) {
 		printf("sqlite3_exec() failed. %s\n", error);
+		sqlite3_free(error);
 		return rc;
 	}
-	rc = sqlite3_exec(db, SQL_CREATE_INDEX, 0, 0, &error);
+
+	for (size_t i = 0; i < sizeof(sql) / sizeof(sql[0]); i++) {
+		rc = sqlite3_exec(db, sql[i], 0, 0, &error);
+		if (rc != SQLITE_OK) {
+			printf("sqlite3_exec() failed. %s\n", error);
+			sqlite3_free(error);
+			return rc;
+		}
+	}
+	return rc;
+}
+// 把 rowid 表 dic 转换为聚簇表. 在一个事务中完成,
+// WAL 模式下其他连接在提交前仍然可以读取旧表
+int migrate(sqlite3* db) {
+	if (clustered(db)) {
+		log_info("dic is already clustered.");
+		return EXIT_SUCCESS;
+	}
+
+	uint64_t t_start = _linux_get_time_ms();
+	char* error;
+	int rc = sqlite3_exec(db, "BEGIN IMMEDIATE;" SQL_MIGRATE_CLUSTERED "COMMIT;", 0, 0, &error);
 	if (rc != SQLITE_OK) {
-		printf("sqlite3_exec() failed. %s\n", error);
-		return rc;
+		log_err("[ERROR]: Migration failed: %s", error);
+		sqlite3_free(error);
+		sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+		return EXIT_FAILURE;
+	}
+	// 回收旧表和索引占用的页
+	rc = sqlite3_exec(db, "VACUUM; PRAGMA wal_checkpoint(TRUNCATE);", 0, 0, &error);
+	if (rc != SQLITE_OK) {
+		log_warn("VACUUM failed: %s", error);
+		sqlite3_free(error);
+	}
+	log_info("Migrated dic to WITHOUT ROWID in %llu ms.",
+	         (unsigned long long)(_linux_get_time_ms() - t_start));
+	return EXIT_SUCCESS;
+}
+int prepare(sqlite3* db, const char* sql, sqlite3_stmt** s) {
+	int rc = sqlite3_prepare_v2(db, sql, -1, s, NULL);
+	if (rc) {
+		fprintf(stderr, "error: Prepare stmt %s failed, %s\n", sql, sqlite3_errmsg(db));
 	}
 	return rc;
 }
@@ -160,21 +452,33 @@ char* url(const char* word, char* buf_path, size_t buf_path_len) {
 	snprintf(buf_path, buf_path_len, "%s%s%d%s", API_KEY, word, salt, API_SECRET);
 
 	char md5_buf[33];
-	MD5_CTX md5_ctx;
-	MD5Init(&md5_ctx);
-	MD5Update(&md5_ctx, buf_path, strlen(buf_path));
-	MD5Final(&md5_ctx);
-	for (int i = 0, j = 0; i < 16; i++) {
-		uint8_t t = md5_ctx.digest[i];
-		md5_buf[j++] = HEX_ARRAY[t / 16];
-		md5_buf[j++] = HEX_ARRAY[t % 16];
-	}
-	md5_buf[32] = 0;
+	uint8_t digest[16];
+	md5(buf_path, strlen(buf_path), digest);
+	md5_hex(digest, md5_buf);
 	memset(buf_path, 0, buf_path_len);
 	snprintf(buf_path, buf_path_len, "/api?q=%s&salt=%d&sign=%s&from=%s&appKey=%s&to=%s",
 	         word, salt, md5_buf, from, API_KEY, to);
 	return buf_path;
 }
+// 批量计算签名 md5(API_KEY + word + salt + API_SECRET), 多条消息在 SIMD 通道中并行计算
+void sign_batch(const char* const* words, size_t n, int salt, char (*signs)[33]) {
+	char in[SIGN_BATCH][MAX_PATH];
+	const uint8_t* msgs[SIGN_BATCH];
+	size_t lens[SIGN_BATCH];
+	uint8_t digests[SIGN_BATCH][16];
+
+	for (size_t i = 0; i < n; i += SIGN_BATCH) {
+		size_t m = n - i < SIGN_BATCH ? n - i : SIGN_BATCH;
+		for (size_t j = 0; j < m; j++) {
+			int len = snprintf(in[j], MAX_PATH, "%s%s%d%s", API_KEY, words[i + j], salt, API_SECRET);
+			msgs[j] = (const uint8_t*)in[j];
+			lens[j] = len < MAX_PATH ? (size_t)len : MAX_PATH - 1;
+		}
+		md5mb(msgs, lens, m, digests);
+		for (size_t j = 0; j < m; j++)
+			md5_hex(digests[j], signs[i + j]);
+	}
+}
 rapidstring* header(rapidstring* s, const char* word) {
 
 	size_t buf_path_len = MAX_PATH << 1;
@@ -202,11 +506,15 @@ uintptr_t connect_socket(const char* host, uint16_t port) {
 	hints.ai_socktype = SOCK_STREAM;
 	hints.ai_protocol = IPPROTO_TCP;
 
+	uint64_t t_start = histo_now_us();
 	ret = getaddrinfo(host, port_str, &hints, &addr_list);
+	histo_record(&s_histo, STAGE_DNS, histo_now_us() - t_start);
 	if (ret) {
 		return 0;
 	}
 
+	t_start = histo_now_us();
+
 	for (cur = addr_list; cur != NULL; cur = cur->ai_next) {
 		fd = (int)socket(cur->ai_family, cur->ai_socktype, cur->ai_protocol);
 		if (fd < 0) {
@@ -224,6 +532,7 @@ uintptr_t connect_socket(const char* host, uint16_t port) {
 	}
 
 	freeaddrinfo(addr_list);
+	histo_record(&s_histo, STAGE_CONNECT, histo_now_us() - t_start);
 
 	return (uintptr_t)ret;
 }
@@ -368,12 +677,14 @@ int read_fully(uintptr_t fd, rapidstring* s, uint32_t timeout_ms) {
 
 	t_end = _linux_get_time_ms() + timeout_ms;
 	err_code = 0;
+	// 第一个字节到达前计入 ttfb, 之后计入 body
+	uint64_t t_start = histo_now_us(), t_first = 0;
 
 	do {
 		t_left = _linux_time_left(t_end, _linux_get_time_ms());
 		if (0 == t_left) {
 			err_code = ERR_TCP_READ_TIMEOUT;
-			printf("timeout \n");
+			log_err("timeout");
 			break;
 		}
 
@@ -388,16 +699,22 @@ int read_fully(uintptr_t fd, rapidstring* s, uint32_t timeout_ms) {
 			ret = recv(fd, buf, buf_size, 0);
 
 			if (ret > 0) {
+				metric_add(s_m.bytes_received, ret);
+				if (t_first == 0) {
+					t_first = histo_now_us();
+					histo_record(&s_histo, STAGE_TTFB, t_first - t_start);
+				}
 
 				rs_cat(s, buf);
 
 				if (indexof(buf, "0\r\n\r\n") != -1) {
+					histo_record(&s_histo, STAGE_BODY, histo_now_us() - t_first);
 					return RET_SUCCESS;
 				}
 				memset(buf, 0, buf_size);
 			} else if (0 == ret) {
 				err_code = ERR_TCP_PEER_SHUTDOWN;
-				printf("tcp_peer_shutdown \n");
+				log_err("tcp_peer_shutdown");
 
 				break;
 			} else {
@@ -405,18 +722,18 @@ int read_fully(uintptr_t fd, rapidstring* s, uint32_t timeout_ms) {
 					continue;
 				}
 				err_code = ERR_TCP_READ_FAIL;
-				printf("ERR_TCP_READ_FAIL \n");
+				log_err("ERR_TCP_READ_FAIL");
 
 				break;
 			}
 		} else if (0 == ret) {
 			err_code = ERR_TCP_READ_TIMEOUT;
-			printf("ERR_TCP_READ_TIMEOUT \n");
+			log_err("ERR_TCP_READ_TIMEOUT");
 
 			break;
 		} else {
 			err_code = ERR_TCP_READ_FAIL;
-			printf("ERR_TCP_READ_FAIL \n");
+			log_err("ERR_TCP_READ_FAIL");
 
 			break;
 		}
@@ -447,44 +764,466 @@ int query_sql(sqlite3* db, const char* key, sqlite3_stmt* s) {
 	sqlite3_reset(s);
 	return rc;
 }
-int insert_sql(sqlite3* db, const char* key, const char* word, sqlite3_stmt* s) {
+// key 是否在 dic 中, 存在时返回 1. 先查缓存, 未命中时用 SQL_QUERY 只查索引,
+// 存在的单词以空值写入缓存, 不读取释义. cache 不能与 definition_sql 共用
+int exists_sql(sqlite3* db, const char* key, sqlite3_stmt* s, cache_t* cache) {
+	size_t len = strlen(key);
+	if (cache && cache_get(cache, key, len, NULL)) {
+		metric_add(s_m.cache_hits, 1);
+		return 1;
+	}
+	if (cache)
+		metric_add(s_m.cache_misses, 1);
+	int rc = query_sql(db, key, s);
+	if (rc == 1 && cache)
+		cache_put(cache, key, len, "", 0);
+	return rc;
+}
+// 读取 key 的释义并追加到 out (可以为 NULL), 存在时返回 1. 先查缓存,
+// 未命中时查询 dic 并写入缓存. 只缓存存在的单词, 新写入的单词不会被旧的结果遮住
+int definition_sql(sqlite3* db, const char* key, sqlite3_stmt* s, cache_t* cache, rapidstring* out) {
+	size_t len = strlen(key);
+	if (cache && cache_get(cache, key, len, out)) {
+		metric_add(s_m.cache_hits, 1);
+		return 1;
+	}
+	if (cache)
+		metric_add(s_m.cache_misses, 1);
+	int rc = sqlite3_bind_text(s, 1, key, (int)len, SQLITE_STATIC);
+	if (rc) {
+		fprintf(stderr, "error: Bind %s to %d failed, %s\n", key, rc, sqlite3_errmsg(db));
+		return -1;
+	}
+	rc = sqlite3_step(s);
+	if (rc == SQLITE_ROW) {
+		const char* word = (const char*)sqlite3_column_text(s, 0);
+		size_t word_len = sqlite3_column_bytes(s, 0);
+		if (cache)
+			cache_put(cache, key, len, word ? word : "", word_len);
+		if (out && word)
+			rs_cat_n(out, word, word_len);
+		rc = 1;
+	} else if (rc == SQLITE_DONE) {
+		rc = 0;
+	} else {
+		fprintf(stderr, "select statement didn't return ROW (%i): %s\n", rc, sqlite3_errmsg(db));
+		rc = -1;
+	}
+	sqlite3_reset(s);
+	return rc;
+}
+int insert_sql(sqlite3* db, const char* key, size_t key_len, const char* word, size_t word_len, sqlite3_stmt* s) {
 	sqlite3_clear_bindings(s);
 
-	int rc = sqlite3_bind_text(s, 1, key, strlen(key), NULL);
+	int rc = sqlite3_bind_text(s, 1, key, key_len, SQLITE_STATIC);
 	if (rc) {
 		fprintf(stderr, "error: Bind %s to %d failed, %s\n", key, rc, sqlite3_errmsg(db));
 		return rc;
 	}
-	rc = sqlite3_bind_text(s, 2, word, strlen(word), NULL);
+	rc = sqlite3_bind_text(s, 2, word, word_len, SQLITE_STATIC);
 	if (rc) {
 		fprintf(stderr, "error: Bind %s to %d failed, %s\n", key, rc, sqlite3_errmsg(db));
 		return rc;
 	}
 	rc = sqlite3_step(s);
-	if (SQLITE_DONE != rc) {
+	if (SQLITE_DONE != rc)
 		fprintf(stderr, "insert statement didn't return DONE (%i): %s\n", rc, sqlite3_errmsg(db));
+	// 失败后也要重置, 否则之后的绑定都会失败
+	sqlite3_reset(s);
+
+	return rc;
+}
+typedef struct batch {
+	sqlite3* db;
+	// 当前事务中的记录数
+	size_t rows;
+	size_t max_rows;
+	// 0 表示不按时间提交
+	uint64_t max_ms;
+	uint64_t t_begin;
+} batch_t;
+
+void batch_init(batch_t* b, sqlite3* db, size_t max_rows, uint64_t max_ms) {
+	b->db = db;
+	b->rows = 0;
+	b->max_rows = max_rows > 0 ? max_rows : 1;
+	b->max_ms = max_ms;
+	b->t_begin = 0;
+}
+// 在写入前调用, 需要时开始新的事务
+int batch_begin(batch_t* b) {
+	if (b->rows > 0 || sqlite3_get_autocommit(b->db) == 0)
+		return SQLITE_OK;
+	char* error;
+	int rc = sqlite3_exec(b->db, "BEGIN", 0, 0, &error);
+	if (rc != SQLITE_OK) {
+		fprintf(stderr, "error: BEGIN failed, %s\n", error);
+		sqlite3_free(error);
 		return rc;
 	}
+	b->t_begin = _linux_get_time_ms();
+	return rc;
+}
+int batch_commit(batch_t* b) {
+	if (sqlite3_get_autocommit(b->db))
+		return SQLITE_OK;
+	char* error;
+	metric_observe(s_m.batch_rows, b->rows);
+	int rc = sqlite3_exec(b->db, "COMMIT", 0, 0, &error);
+	if (rc != SQLITE_OK) {
+		// 整个批次回滚, 已提交的批次不受影响
+		fprintf(stderr, "error: COMMIT of %zu rows failed, %s\n", b->rows, error);
+		sqlite3_free(error);
+		sqlite3_exec(b->db, "ROLLBACK", 0, 0, 0);
+	}
+	b->rows = 0;
+	return rc;
+}
+// 到达时间限制时提交, 没有新的写入时也应定期调用
+int batch_tick(batch_t* b) {
+	if (b->rows > 0 && b->max_ms > 0 && _linux_get_time_ms() - b->t_begin >= b->max_ms)
+		return batch_commit(b);
+	return SQLITE_OK;
+}
+// 在每条记录写入后调用
+int batch_end(batch_t* b) {
+	if (++b->rows >= b->max_rows)
+		return batch_commit(b);
+	return batch_tick(b);
+}
+int bind_string(sqlite3_stmt* s, int i, const cJSON* item) {
+	if (!cJSON_IsString(item))
+		return sqlite3_bind_null(s, i);
+	return sqlite3_bind_text(s, i, item->valuestring, -1, SQLITE_STATIC);
+}
+int step_sql(sqlite3* db, sqlite3_stmt* s) {
+	int rc = sqlite3_step(s);
+	if (SQLITE_DONE != rc) {
+		fprintf(stderr, "insert statement didn't return DONE (%i): %s\n", rc, sqlite3_errmsg(db));
+	}
 	sqlite3_reset(s);
+	return rc;
+}
+typedef struct writer {
+	// 写入线程独占的连接和语句
+	sqlite3* db;
+	sqlite3_stmt* insert;
+	sqlite3_stmt* insert_entry;
+	sqlite3_stmt* insert_sense;
+	sqlite3_stmt* insert_web_phrase;
+	sqlite3_stmt* insert_word_form;
+	sqlite3_stmt* insert_inflection;
+	batch_t batch;
+	mpsc_t queue;
+	pthread_t thread;
+} writer_t;
+
+// 网络线程解析完成后交给写入线程的词条
+typedef struct entry {
+	char* key;
+	cJSON* json;
+	// 不为 NULL 时只写入词形, 以 \0 分隔
+	char* forms;
+	size_t forms_len;
+} entry_t;
+
+static writer_t s_writer;
+
+// 一次遍历 Youdao 的响应, 同时写入结构化的词条表
+// 并在 s 中拼接 dic 表使用的纯文本释义. 任何一条写入失败时回滚整个词条
+int entry_sql(writer_t* w, const char* key, const cJSON* json, rapidstring* s) {
+	sqlite3* db = w->db;
+	const cJSON* basic = cJSON_GetObjectItem(json, "basic");
+	const cJSON* web = cJSON_GetObjectItem(json, "web");
+
+	// 查询失败时响应中只有 errorCode
+	if (basic == NULL && web == NULL)
+		return SQLITE_DONE;
+
+	// 翻译可能有多条, 以换行分隔
+	rapidstring translation;
+	rs_init(&translation);
+	const cJSON* t = NULL;
+	cJSON_ArrayForEach(t, cJSON_GetObjectItem(json, "translation")) {
+		if (!cJSON_IsString(t))
+			continue;
+		if (!rs_empty(&translation))
+			rs_cat_n(&translation, "\n", 1);
+		rs_cat_n(&translation, t->valuestring, strlen(t->valuestring));
+	}
+
+	int rc = sqlite3_exec(db, "SAVEPOINT entry", 0, 0, 0);
+	if (rc != SQLITE_OK) {
+		fprintf(stderr, "error: SAVEPOINT failed (%i): %s\n", rc, sqlite3_errmsg(db));
+		rs_free(&translation);
+		return rc;
+	}
+
+	sqlite3_clear_bindings(w->insert_entry);
+	sqlite3_bind_text(w->insert_entry, 1, key, -1, SQLITE_STATIC);
+	bind_string(w->insert_entry, 2, cJSON_GetObjectItem(basic, "phonetic"));
+	bind_string(w->insert_entry, 3, cJSON_GetObjectItem(basic, "us-phonetic"));
+	bind_string(w->insert_entry, 4, cJSON_GetObjectItem(basic, "uk-phonetic"));
+	if (rs_empty(&translation))
+		sqlite3_bind_null(w->insert_entry, 5);
+	else
+		sqlite3_bind_text(w->insert_entry, 5, rs_data(&translation), rs_len(&translation), SQLITE_STATIC);
+	bind_string(w->insert_entry, 6, cJSON_GetObjectItem(json, "speakUrl"));
+	rc = step_sql(db, w->insert_entry);
+	rs_free(&translation);
+	if (rc != SQLITE_DONE)
+		goto rollback;
+	sqlite3_int64 id = sqlite3_last_insert_rowid(db);
+
+	// 基本释义, 每行一条
+	int pos = 0;
+	const cJSON* explain = NULL;
+	cJSON_ArrayForEach(explain, cJSON_GetObjectItem(basic, "explains")) {
+		if (!cJSON_IsString(explain))
+			continue;
+		size_t len = strlen(explain->valuestring);
+		rs_cat_n(s, explain->valuestring, len);
+		rs_cat_n(s, "\n", 1);
+
+		sqlite3_bind_int64(w->insert_sense, 1, id);
+		sqlite3_bind_int(w->insert_sense, 2, pos++);
+		sqlite3_bind_text(w->insert_sense, 3, explain->valuestring, len, SQLITE_STATIC);
+		if ((rc = step_sql(db, w->insert_sense)) != SQLITE_DONE)
+			goto rollback;
+	}
 
+	// 网络释义: "短语 释义1,释义2\n"
+	const cJSON* item = NULL;
+	cJSON_ArrayForEach(item, web) {
+		const cJSON* phrase = cJSON_GetObjectItem(item, "key");
+		if (!cJSON_IsString(phrase))
+			continue;
+		size_t phrase_len = strlen(phrase->valuestring);
+		rs_cat_n(s, phrase->valuestring, phrase_len);
+		rs_cat_n(s, " ", 1);
+		const cJSON* value = NULL;
+		cJSON_ArrayForEach(value, cJSON_GetObjectItem(item, "value")) {
+			if (!cJSON_IsString(value))
+				continue;
+			size_t len = strlen(value->valuestring);
+			rs_cat_n(s, value->valuestring, len);
+			rs_cat_n(s, ",", 1);
+
+			sqlite3_bind_int64(w->insert_web_phrase, 1, id);
+			sqlite3_bind_text(w->insert_web_phrase, 2, phrase->valuestring, phrase_len, SQLITE_STATIC);
+			sqlite3_bind_text(w->insert_web_phrase, 3, value->valuestring, len, SQLITE_STATIC);
+			if ((rc = step_sql(db, w->insert_web_phrase)) != SQLITE_DONE)
+				goto rollback;
+		}
+		// 最后的 ',' (或没有释义时的 ' ') 换成换行
+		rs_data(s)[rs_len(s) - 1] = '\n';
+	}
+
+	// 词形变化: [{"wf": {"name": "复数", "value": "words"}}]
+	const cJSON* wf = NULL;
+	cJSON_ArrayForEach(wf, cJSON_GetObjectItem(basic, "wfs")) {
+		const cJSON* form = cJSON_GetObjectItem(wf, "wf");
+		const cJSON* name = cJSON_GetObjectItem(form, "name");
+		const cJSON* value = cJSON_GetObjectItem(form, "value");
+		if (!cJSON_IsString(name) || !cJSON_IsString(value))
+			continue;
+		sqlite3_bind_int64(w->insert_word_form, 1, id);
+		bind_string(w->insert_word_form, 2, name);
+		bind_string(w->insert_word_form, 3, value);
+		if ((rc = step_sql(db, w->insert_word_form)) != SQLITE_DONE)
+			goto rollback;
+	}
+
+	rc = sqlite3_exec(db, "RELEASE entry", 0, 0, 0);
+	if (rc == SQLITE_OK)
+		return SQLITE_DONE;
+	fprintf(stderr, "error: RELEASE failed (%i): %s\n", rc, sqlite3_errmsg(db));
+
+rollback:
+	// 只写入一部分的词条不保留, dic 也不写入
+	sqlite3_exec(db, "ROLLBACK TO entry; RELEASE entry", 0, 0, 0);
+	rs_clear(s);
 	return rc;
 }
-int query(const char* word) {
+// 记录书中出现的词形
+void inflection_sql(writer_t* w, const char* key, const char* forms, size_t forms_len) {
+	for (const char* p = forms; p < forms + forms_len; p += strlen(p) + 1) {
+		batch_begin(&w->batch);
+		sqlite3_bind_text(w->insert_inflection, 1, key, -1, SQLITE_STATIC);
+		sqlite3_bind_text(w->insert_inflection, 2, p, -1, SQLITE_STATIC);
+		step_sql(w->db, w->insert_inflection);
+		batch_end(&w->batch);
+	}
+}
+void writer_write(writer_t* w, entry_t* e, rapidstring* s) {
+	if (e->forms) {
+		inflection_sql(w, e->key, e->forms, e->forms_len);
+		return;
+	}
+	uint64_t t_start = histo_now_us();
+	rs_clear(s);
+	batch_begin(&w->batch);
+	int rc = entry_sql(w, e->key, e->json, s);
+
+	if (rc != SQLITE_DONE) {
+		log_err("[ERROR]: %s %s", e->key, "Write entry failed.");
+	} else if (rs_len(s) > 0) {
+		insert_sql(w->db, e->key, strlen(e->key), rs_data(s), rs_len(s), w->insert);
+		histo_record(&s_histo, STAGE_INSERT, histo_now_us() - t_start);
+	} else {
+		log_err("[ERROR]: %s %s", e->key, "Result is empty.");
+	}
+	// 释义为空时 entry_sql 也可能已经写入 entries, 同样计入批次,
+	// 否则 rows 为 0 时 batch_tick 不会提交, 写锁一直不释放
+	batch_end(&w->batch);
+}
+void* writer_run(void* arg) {
+	writer_t* w = arg;
+	rapidstring s;
+	rs_init(&s);
+	trace_thread_name(&s_trace, "writer");
+
+	for (;;) {
+		entry_t* e = mpsc_try_pop(&w->queue);
+		if (e == NULL) {
+			// 关闭后再检查一次, 保证队列中的词条都已写入
+			if (mpsc_closed(&w->queue) && (e = mpsc_try_pop(&w->queue)) == NULL)
+				break;
+			if (e == NULL) {
+				batch_tick(&w->batch);
+				mpsc_sleep_ms(1);
+				continue;
+			}
+		}
+		trace_begin(&s_trace, "insert", e->key);
+		writer_write(w, e, &s);
+		trace_end(&s_trace, "insert");
+		cJSON_Delete(e->json);
+		free(e->key);
+		free(e->forms);
+		free(e);
+	}
+	batch_commit(&w->batch);
+	rs_free(&s);
+	return NULL;
+}
+int writer_start(writer_t* w) {
+	memset(w, 0, sizeof(*w));
+	w->db = database();
+	if (w->db == NULL)
+		return -1;
+	if (prepare(w->db, SQL_INSERT, &w->insert) ||
+	        prepare(w->db, SQL_INSERT_ENTRY, &w->insert_entry) ||
+	        prepare(w->db, SQL_INSERT_SENSE, &w->insert_sense) ||
+	        prepare(w->db, SQL_INSERT_WEB_PHRASE, &w->insert_web_phrase) ||
+	        prepare(w->db, SQL_INSERT_WORD_FORM, &w->insert_word_form) ||
+	        prepare(w->db, SQL_INSERT_INFLECTION, &w->insert_inflection)) {
+		sqlite3_close_v2(w->db);
+		return -1;
+	}
+	batch_init(&w->batch, w->db, setting("YOUDAO_BATCH_ROWS", BATCH_ROWS), setting("YOUDAO_BATCH_MS", BATCH_MS));
+	if (mpsc_init(&w->queue, WRITER_QUEUE_SIZE) ||
+	        pthread_create(&w->thread, NULL, writer_run, w)) {
+		sqlite3_close_v2(w->db);
+		return -1;
+	}
+	return 0;
+}
+// 接管 json 的所有权. 写入线程落后时阻塞
+void writer_push(writer_t* w, const char* key, cJSON* json) {
+	entry_t* e = malloc(sizeof(entry_t));
+	e->key = strdup(key);
+	e->json = json;
+	e->forms = NULL;
+	e->forms_len = 0;
+	mpsc_push(&w->queue, e);
+}
+void writer_push_forms(writer_t* w, const char* key, const char* forms, size_t forms_len) {
+	entry_t* e = malloc(sizeof(entry_t));
+	e->key = strdup(key);
+	e->json = NULL;
+	e->forms = malloc(forms_len);
+	memcpy(e->forms, forms, forms_len);
+	e->forms_len = forms_len;
+	mpsc_push(&w->queue, e);
+}
+// 等待队列中的词条全部写入并提交
+void writer_stop(writer_t* w) {
+	mpsc_close(&w->queue);
+	pthread_join(w->thread, NULL);
+	mpsc_free(&w->queue);
+	sqlite3_finalize(w->insert);
+	sqlite3_finalize(w->insert_entry);
+	sqlite3_finalize(w->insert_sense);
+	sqlite3_finalize(w->insert_web_phrase);
+	sqlite3_finalize(w->insert_word_form);
+	sqlite3_finalize(w->insert_inflection);
+	sqlite3_close(w->db);
+}
+// 用 dic 中的所有 key 建立拼写纠正索引
+int spell_index(sqlite3* db, symspell_t* spell) {
+	sqlite3_stmt* s;
+	int rc;
+
+	symspell_init(spell);
+	if (prepare(db, SQL_KEYS, &s))
+		return -1;
+	while ((rc = sqlite3_step(s)) == SQLITE_ROW) {
+		const char* key = (const char*)sqlite3_column_text(s, 0);
+		if (key && symspell_add(spell, key, sqlite3_column_bytes(s, 0))) {
+			rc = SQLITE_NOMEM;
+			break;
+		}
+	}
+	sqlite3_finalize(s);
+	if (rc == SQLITE_DONE && symspell_build(spell))
+		rc = SQLITE_NOMEM;
+	if (rc != SQLITE_DONE) {
+		fprintf(stderr, "error: Load keys failed (%i): %s\n", rc, sqlite3_errmsg(db));
+		symspell_free(spell);
+		return -1;
+	}
+	return 0;
+}
+
+// 返回 word 唯一最接近的已有单词, 没有或有多个同样接近的单词时返回 NULL
+const char* spell_correct(symspell_t* spell, const char* word, int max_distance, size_t* len) {
+	symspell_suggestion_t found[2];
+	size_t word_len = strlen(word);
+	int allowed = word_len >= 9 ? 2 : word_len >= 5 ? 1 : 0;
 
+	if (allowed > max_distance)
+		allowed = max_distance;
+	if (allowed == 0)
+		return NULL;
+	size_t n = symspell_lookup(spell, word, word_len, allowed, found, 2);
+	if (n == 0 || (n == 2 && found[1].distance == found[0].distance))
+		return NULL;
+	return symspell_word(spell, found[0].word, len);
+}
+
+int query_word(const char* word) {
+
+	trace_begin(&s_trace, "connect", word);
 	uintptr_t fd = connect_socket(DEFAULT_HOST, DEFAULT_PORT);
+	trace_end(&s_trace, "connect");
 
 	if (fd == 0) {
-		printf("connect_socket() \n");
+		log_err("connect_socket() %s", word);
 		return 0;
 	}
 
 	rapidstring s;
 	rs_init(&s);
+	trace_begin(&s_trace, "request", word);
 	header(&s, word);
 
 	size_t written_len = 0;
 
+	uint64_t t_start = histo_now_us();
 	int rc = write(fd, rs_data(&s), rs_len(&s), 10000, &written_len);
+	histo_record(&s_histo, STAGE_SEND, histo_now_us() - t_start);
+	trace_end(&s_trace, "request");
 
 	if (rc != RET_SUCCESS) {
 		CLOSESOCKET(fd);
@@ -494,7 +1233,9 @@ int query(const char* word) {
 	size_t read_len = 0;
 
 	rs_clear(&s);
+	trace_begin(&s_trace, "response", word);
 	rc = read_fully(fd, &s, 10000);
+	trace_end(&s_trace, "response");
 
 	if (rc != RET_SUCCESS) {
 		rs_free(&s);
@@ -520,48 +1261,30 @@ int query(const char* word) {
 		CLOSESOCKET(fd);
 		return 0;
 	}
-	size_t buf_body_len = 1024 << 2, buf_body_read_len = 0;
-	char buf_body[buf_body_len];
-	memset(buf_body, 0, buf_body_len);
-
 	//printf("%s\n", buf);
 
+	trace_begin(&s_trace, "parse", word);
+	t_start = histo_now_us();
 	cJSON* json = cJSON_Parse(buf);
+	histo_record(&s_histo, STAGE_PARSE, histo_now_us() - t_start);
+	trace_end(&s_trace, "parse");
 	if (json == NULL) {
 		const char* error_ptr = cJSON_GetErrorPtr();
 		if (error_ptr != NULL) {
-			printf("%s\n", error_ptr);
+			log_err("%s", error_ptr);
 			goto error;
 		}
 	}
-	const cJSON* basic = cJSON_GetObjectItem(json, "basic");
-	const cJSON* explains = cJSON_GetObjectItem(basic, "explains");
-	const cJSON* explain = NULL;
-	cJSON_ArrayForEach(explain, explains) {
-		strcat(buf_body, explain->valuestring);
-		strcat(buf_body, "\n");
-	};
-	const cJSON* web = cJSON_GetObjectItem(json, "web");
-	const cJSON* w = NULL;
-	cJSON_ArrayForEach(w, web) {
-		strcat(buf_body, cJSON_GetObjectItem(w, "key")->valuestring);
-		const cJSON* values = cJSON_GetObjectItem(w, "value");
-		const cJSON* value = NULL;
-		strcat(buf_body, " ");
-		cJSON_ArrayForEach(value, values) {
-			strcat(buf_body, value->valuestring);
-			strcat(buf_body, ",");
-		}
-		buf_body[strlen(buf_body) - 1] = '\n';
-	}
 
-	if (strlen(buf_body) > 0) {
-		insert_sql(db, word, buf_body, s_insert);
-	} else {
+	// 按错误码统计失败的查询
+	const cJSON* code = cJSON_GetObjectItem(json, "errorCode");
+	if (cJSON_IsString(code) && strcmp(code->valuestring, "0") != 0)
+		metric_add(metrics_labeled(&s_metrics, s_m.api_errors, code->valuestring), 1);
 
-		// printf("[ERROR]: %s %s\n", word,rs_data(&s));
-
-		log_err("[ERROR]: %s\n", "Result is empty.");
+	// 由写入线程格式化并写入数据库
+	if (json != NULL) {
+		writer_push(&s_writer, word, json);
+		json = NULL;
 	}
 
 error:
@@ -570,8 +1293,606 @@ error:
 	CLOSESOCKET(fd);
 	return 0;
 }
+int query(const char* word) {
+	metric_add(s_m.in_flight, 1);
+	int rc = query_word(word);
+	metric_add(s_m.in_flight, -1);
+	return rc;
+}
+
+typedef struct import_job {
+	// 输入: 若干完整的 NDJSON 行
+	char* buf;
+	size_t len;
+	// 输出: 解析后的 key\0word\0 记录
+	rapidstring records;
+	size_t count;
+	list_head_t list;
+} import_job_t;
+
+typedef struct import_queue {
+	list_head_t head;
+	size_t depth;
+	metric_t* gauge;
+	int closed;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+} import_queue_t;
+
+typedef struct import_ctx {
+	import_queue_t lines;
+	import_queue_t records;
+	size_t parsed;
+	size_t failed;
+	// 只计入已经提交的记录
+	size_t inserted;
+	// 准备语句, 写入或提交失败过
+	int error;
+	pthread_mutex_t lock;
+} import_ctx_t;
+
+void import_queue_init(import_queue_t* q) {
+	INIT_LIST_HEAD(&q->head);
+	q->depth = 0;
+	q->gauge = NULL;
+	q->closed = 0;
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->not_empty, NULL);
+	pthread_cond_init(&q->not_full, NULL);
+}
+
+void import_queue_destroy(import_queue_t* q) {
+	pthread_mutex_destroy(&q->lock);
+	pthread_cond_destroy(&q->not_empty);
+	pthread_cond_destroy(&q->not_full);
+}
+
+void import_queue_push(import_queue_t* q, import_job_t* job) {
+	pthread_mutex_lock(&q->lock);
+	// 队列满时阻塞, 避免读取速度超过解析速度时内存无限增长
+	while (q->depth >= IMPORT_QUEUE_DEPTH)
+		pthread_cond_wait(&q->not_full, &q->lock);
+	list_add_tail(&job->list, &q->head);
+	q->depth++;
+	metric_set(q->gauge, q->depth);
+	pthread_cond_signal(&q->not_empty);
+	pthread_mutex_unlock(&q->lock);
+}
+
+import_job_t* import_queue_pop(import_queue_t* q) {
+	import_job_t* job = NULL;
+
+	pthread_mutex_lock(&q->lock);
+	while (list_empty(&q->head) && !q->closed)
+		pthread_cond_wait(&q->not_empty, &q->lock);
+	if (!list_empty(&q->head)) {
+		job = list_first_entry(&q->head, import_job_t, list);
+		list_del(&job->list);
+		q->depth--;
+		metric_set(q->gauge, q->depth);
+		pthread_cond_signal(&q->not_full);
+	}
+	pthread_mutex_unlock(&q->lock);
+	return job;
+}
+
+void import_queue_close(import_queue_t* q) {
+	pthread_mutex_lock(&q->lock);
+	q->closed = 1;
+	pthread_cond_broadcast(&q->not_empty);
+	pthread_mutex_unlock(&q->lock);
+}
+
+void* import_worker(void* arg) {
+	import_ctx_t* ctx = arg;
+	import_job_t* job;
+
+	while ((job = import_queue_pop(&ctx->lines)) != NULL) {
+		size_t failed = 0;
+		char* line = job->buf;
+		char* end = job->buf + job->len;
+
+		rs_init_w_cap(&job->records, job->len);
+		job->count = 0;
+
+		while (line < end) {
+			char* eol = memchr(line, '\n', end - line);
+			if (eol == NULL)
+				eol = end;
+			*eol = 0;
+
+			// 跳过空行
+			char* p = line;
+			while (p < eol && isspace((unsigned char)*p))
+				p++;
+			if (p < eol) {
+				cJSON* json = cJSON_Parse(p);
+				const cJSON* key = cJSON_GetObjectItem(json, "key");
+				const cJSON* word = cJSON_GetObjectItem(json, "word");
+				if (cJSON_IsString(key) && cJSON_IsString(word)) {
+					rs_cat_n(&job->records, key->valuestring, strlen(key->valuestring) + 1);
+					rs_cat_n(&job->records, word->valuestring, strlen(word->valuestring) + 1);
+					job->count++;
+				} else {
+					failed++;
+				}
+				cJSON_Delete(json);
+			}
+			line = eol + 1;
+		}
+
+		free(job->buf);
+		job->buf = NULL;
+
+		pthread_mutex_lock(&ctx->lock);
+		ctx->parsed += job->count;
+		ctx->failed += failed;
+		pthread_mutex_unlock(&ctx->lock);
+
+		import_queue_push(&ctx->records, job);
+	}
+	return NULL;
+}
+
+// 批次提交后调用: 成功时计入本批写入的记录, 失败时整批已经回滚
+void import_committed(import_ctx_t* ctx, size_t* pending, int rc) {
+	if (rc == SQLITE_OK)
+		ctx->inserted += *pending;
+	else
+		ctx->error = 1;
+	*pending = 0;
+}
+
+void* import_writer(void* arg) {
+	import_ctx_t* ctx = arg;
+	import_job_t* job;
+	sqlite3_stmt* s;
+	batch_t batch;
+	size_t pending = 0;
+
+	// 每 IMPORT_BATCH_SIZE 条记录提交一次事务
+	batch_init(&batch, db, IMPORT_BATCH_SIZE, 0);
+
+	if (sqlite3_prepare_v2(db, SQL_IMPORT, -1, &s, NULL)) {
+		fprintf(stderr, "error: Prepare stmt stmt_import failed, %s\n", sqlite3_errmsg(db));
+		s = NULL;
+		ctx->error = 1;
+	}
+
+	while ((job = import_queue_pop(&ctx->records)) != NULL) {
+		const char* p = rs_data(&job->records);
+
+		for (size_t i = 0; s != NULL && i < job->count; i++) {
+			const char* key = p;
+			size_t key_len = strlen(key);
+			const char* word = key + key_len + 1;
+			size_t word_len = strlen(word);
+			p = word + word_len + 1;
+
+			batch_begin(&batch);
+			if (insert_sql(db, key, key_len, word, word_len, s) == SQLITE_DONE)
+				pending += sqlite3_changes(db);
+			else
+				ctx->error = 1;
+			int rc = batch_end(&batch);
+			// 提交过后 rows 清零
+			if (batch.rows == 0)
+				import_committed(ctx, &pending, rc);
+		}
+		rs_free(&job->records);
+		free(job);
+	}
+	import_committed(ctx, &pending, batch_commit(&batch));
+	sqlite3_finalize(s);
+	return NULL;
+}
+
+int import(const char* filename, int threads) {
+	FILE* f = fopen(filename, "rb");
+	if (!f) {
+		log_err("[ERROR]: Can't open %s: %s", filename, clean_errno());
+		return EXIT_FAILURE;
+	}
+	if (threads <= 0)
+		threads = IMPORT_THREADS;
+
+	uint64_t t_start = _linux_get_time_ms();
+
+	import_ctx_t ctx = { 0 };
+	import_queue_init(&ctx.lines);
+	import_queue_init(&ctx.records);
+	ctx.lines.gauge = metrics_labeled(&s_metrics, s_m.queue_depth, "import_lines");
+	ctx.records.gauge = metrics_labeled(&s_metrics, s_m.queue_depth, "import_records");
+	pthread_mutex_init(&ctx.lock, NULL);
+
+	pthread_t workers[threads];
+	pthread_t writer;
+	for (int i = 0; i < threads; i++)
+		pthread_create(&workers[i], NULL, import_worker, &ctx);
+	pthread_create(&writer, NULL, import_writer, &ctx);
+
+	// 按块读取文件, 每块只包含完整的行,
+	// 最后一个不完整的行留给下一块
+	char* carry = NULL;
+	size_t carry_len = 0;
+	for (;;) {
+		char* buf = malloc(carry_len + IMPORT_CHUNK_SIZE + 1);
+		if (carry_len > 0)
+			memcpy(buf, carry, carry_len);
+		free(carry);
+		carry = NULL;
+
+		size_t n = fread(buf + carry_len, 1, IMPORT_CHUNK_SIZE, f);
+		size_t len = carry_len + n;
+		carry_len = 0;
+
+		if (n == 0) {
+			if (len == 0) {
+				free(buf);
+				break;
+			}
+		} else {
+			char* eol = buf + len;
+			while (eol > buf && eol[-1] != '\n')
+				eol--;
+			if (eol == buf) {
+				// 行比块还长, 继续读取
+				carry = buf;
+				carry_len = len;
+				continue;
+			}
+			carry_len = buf + len - eol;
+			if (carry_len > 0) {
+				carry = malloc(carry_len);
+				memcpy(carry, eol, carry_len);
+			}
+			len = eol - buf;
+		}
+
+		import_job_t* job = calloc(1, sizeof(import_job_t));
+		job->buf = buf;
+		job->len = len;
+		import_queue_push(&ctx.lines, job);
+		if (n == 0)
+			break;
+	}
+	fclose(f);
+
+	import_queue_close(&ctx.lines);
+	for (int i = 0; i < threads; i++)
+		pthread_join(workers[i], NULL);
+	import_queue_close(&ctx.records);
+	pthread_join(writer, NULL);
+
+	log_info("Imported %zu of %zu records (%zu malformed) in %llu ms.",
+	         ctx.inserted, ctx.parsed, ctx.failed,
+	         (unsigned long long)(_linux_get_time_ms() - t_start));
+	if (ctx.error)
+		log_err("[ERROR]: Import of %s failed, records that were not committed are not counted.", filename);
+
+	import_queue_destroy(&ctx.lines);
+	import_queue_destroy(&ctx.records);
+	pthread_mutex_destroy(&ctx.lock);
+	return ctx.error ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// 查询服务使用的词典快照. 后台线程在 dic 变化时重建索引, 通过 RCU 切换,
+// 服务线程查询时不加锁也不会被重建阻塞
+typedef struct snapshot {
+	rcu_t rcu;
+	// 服务线程的读者和它在当前临界区中使用的索引
+	rcu_reader_t* reader;
+	dict_t* dict;
+	uint64_t interval_ms;
+	pthread_t thread;
+} snapshot_t;
+
+// 其他连接提交写入后 data_version 会变化
+int64_t data_version(sqlite3* db) {
+	sqlite3_stmt* s;
+	int64_t version = -1;
+	if (prepare(db, SQL_DATA_VERSION, &s))
+		return -1;
+	if (sqlite3_step(s) == SQLITE_ROW)
+		version = sqlite3_column_int64(s, 0);
+	sqlite3_finalize(s);
+	return version;
+}
+void* snapshot_run(void* arg) {
+	snapshot_t* s = arg;
+	sqlite3* db = database();
+	int64_t version = data_version(db);
+
+	while (!s_server_stop) {
+		for (uint64_t waited = 0; waited < s->interval_ms && !s_server_stop; waited += 100)
+			rcu_sleep_ms(100);
+		int64_t v = data_version(db);
+		if (s_server_stop || v == version)
+			continue;
+
+		// 失败时不更新 version, 下一个间隔重试
+		uint64_t t_start = _linux_get_time_ms();
+		dict_t* dict = malloc(sizeof(dict_t));
+		if (dict == NULL || dict_load(db, dict)) {
+			log_err("Reload failed, keeping the current index.");
+			free(dict);
+			continue;
+		}
+		dict_t* old = rcu_replace(&s->rcu, dict);
+		version = v;
+		dict_free(old);
+		free(old);
+		log_info("Reloaded %u words in %llu ms.", dict->count,
+		         (unsigned long long)(_linux_get_time_ms() - t_start));
+	}
+	sqlite3_close(db);
+	return NULL;
+}
+void snapshot_enter(void* ctx) {
+	snapshot_t* s = ctx;
+	s->dict = rcu_read_lock(&s->rcu, s->reader);
+}
+void snapshot_leave(void* ctx) {
+	snapshot_t* s = ctx;
+	rcu_read_unlock(s->reader);
+}
+const char* snapshot_lookup(void* ctx, const char* key, size_t len, size_t* word_len) {
+	snapshot_t* s = ctx;
+	return dict_lookup(s->dict, key, len, word_len);
+}
+// 基准测试: 录制的有道响应
+static const char BENCH_RESPONSE[] =
+    "{\"returnPhrase\":[\"hope\"],\"query\":\"hope\",\"errorCode\":\"0\",\"l\":\"en2zh-CHS\","
+    "\"tSpeakUrl\":\"https://openapi.youdao.com/ttsapi?q=%E5%B8%8C%E6%9C%9B&langType=zh-CHS&sign=3C6E0A0D9B0F2E5F&salt=1577810414&voice=4&format=mp3&appKey=70c363ebfaccfe32\","
+    "\"web\":[{\"value\":[\"希望\",\"期望\",\"愿望\"],\"key\":\"hope\"},{\"value\":[\"好望角\"],\"key\":\"Cape of Good Hope\"},"
+    "{\"value\":[\"希望之光\",\"曙光\"],\"key\":\"Hope Light\"}],"
+    "\"requestId\":\"8c1a3e2b-4f0d-4c1b-9a53-2f6b7d0e9c41\",\"translation\":[\"希望\"],"
+    "\"dict\":{\"url\":\"yddict://m.youdao.com/dict?le=eng&q=hope\"},\"webdict\":{\"url\":\"http://mobile.youdao.com/dict?le=eng&q=hope\"},"
+    "\"basic\":{\"exam_type\":[\"初中\",\"高中\",\"CET4\",\"CET6\",\"考研\"],\"us-phonetic\":\"hoʊp\",\"phonetic\":\"həʊp\",\"uk-phonetic\":\"həʊp\","
+    "\"wfs\":[{\"wf\":{\"name\":\"复数\",\"value\":\"hopes\"}},{\"wf\":{\"name\":\"过去式\",\"value\":\"hoped\"}},"
+    "{\"wf\":{\"name\":\"过去分词\",\"value\":\"hoped\"}},{\"wf\":{\"name\":\"现在分词\",\"value\":\"hoping\"}},"
+    "{\"wf\":{\"name\":\"第三人称单数\",\"value\":\"hopes\"}}],"
+    "\"uk-speech\":\"https://openapi.youdao.com/ttsapi?q=hope&langType=en&sign=7F1B&salt=1577810414&voice=5&format=mp3&appKey=70c363ebfaccfe32\","
+    "\"explains\":[\"n. 希望；期望；希望的东西；被寄予希望的人或事\",\"v. 希望，盼望；期望\"],"
+    "\"us-speech\":\"https://openapi.youdao.com/ttsapi?q=hope&langType=en&sign=7F1B&salt=1577810414&voice=6&format=mp3&appKey=70c363ebfaccfe32\"},"
+    "\"isWord\":true,\"speakUrl\":\"https://openapi.youdao.com/ttsapi?q=hope&langType=en&sign=7F1B&salt=1577810414&voice=4&format=mp3&appKey=70c363ebfaccfe32\"}";
+
+typedef struct bench_insert {
+	sqlite3* db;
+	sqlite3_stmt* s;
+	size_t next;
+	int transaction;
+} bench_insert_t;
+
+void bench_collect(void* ctx, size_t iters) {
+	for (size_t i = 0; i < iters; i++) {
+		list_head_t* list = collect(ctx);
+		word_t *pos, *tmp;
+		if (list == NULL)
+			return;
+		list_for_each_entry_safe(pos, tmp, list, list, word_t) {
+			list_del(&pos->list);
+			rs_free(&pos->forms);
+			free(pos->buf);
+			free(pos);
+		}
+	}
+}
+void bench_md5(void* ctx, size_t iters) {
+	const char* input = ctx;
+	size_t len = strlen(input);
+	uint8_t digest[16];
+	for (size_t i = 0; i < iters; i++)
+		md5(input, len, digest);
+}
+// 整本书的指纹
+void bench_md5_file(void* ctx, size_t iters) {
+	const rapidstring* content = ctx;
+	uint8_t digest[16];
+	for (size_t i = 0; i < iters; i++)
+		md5(rs_data_c(content), rs_len(content), digest);
+}
+// 每次操作为一条消息, 按 SIGN_BATCH 条一批计算
+void bench_md5mb(void* ctx, size_t iters) {
+	const uint8_t* msgs[SIGN_BATCH];
+	size_t lens[SIGN_BATCH];
+	uint8_t digests[SIGN_BATCH][16];
+	for (size_t i = 0; i < SIGN_BATCH; i++) {
+		msgs[i] = ctx;
+		lens[i] = strlen(ctx);
+	}
+	for (size_t i = 0; i < iters; i += SIGN_BATCH)
+		md5mb(msgs, lens, iters - i < SIGN_BATCH ? iters - i : SIGN_BATCH, digests);
+}
+void bench_sign_batch(void* ctx, size_t iters) {
+	const char* words[SIGN_BATCH];
+	char signs[SIGN_BATCH][33];
+	for (size_t i = 0; i < SIGN_BATCH; i++)
+		words[i] = ctx;
+	for (size_t i = 0; i < iters; i += SIGN_BATCH)
+		sign_batch(words, iters - i < SIGN_BATCH ? iters - i : SIGN_BATCH, 1577810414, signs);
+}
+void bench_url(void* ctx, size_t iters) {
+	char buf_path[MAX_PATH << 1];
+	for (size_t i = 0; i < iters; i++)
+		url(ctx, buf_path, sizeof(buf_path));
+}
+void bench_cjson(void* ctx, size_t iters) {
+	for (size_t i = 0; i < iters; i++)
+		cJSON_Delete(cJSON_Parse(ctx));
+}
+// 每次操作追加 1024 次, 每次 *size 字节, 从空字符串开始
+void bench_rs_cat(void* ctx, size_t iters) {
+	static const char chunk[4096];
+	size_t size = *(size_t*)ctx;
+	rapidstring s;
+	for (size_t i = 0; i < iters; i++) {
+		rs_init(&s);
+		for (int j = 0; j < 1024; j++)
+			rs_cat_n(&s, chunk, size);
+		rs_free(&s);
+	}
+}
+void bench_insert(void* ctx, size_t iters) {
+	static const char word[] = "n. 希望；期望\n";
+	bench_insert_t* b = ctx;
+	char key[32];
+	if (b->transaction)
+		sqlite3_exec(b->db, "BEGIN", 0, 0, 0);
+	for (size_t i = 0; i < iters; i++) {
+		int len = snprintf(key, sizeof(key), "w%zu", b->next++);
+		insert_sql(b->db, key, len, word, sizeof(word) - 1, b->s);
+	}
+	if (b->transaction)
+		sqlite3_exec(b->db, "COMMIT", 0, 0, 0);
+}
+// read_fully() 在每次读到的 1 KB 中查找分块结束标记
+void bench_indexof(void* ctx, size_t iters) {
+	volatile int found = 0;
+	for (size_t i = 0; i < iters; i++)
+		found += indexof(ctx, "0\r\n\r\n");
+	(void)found;
+}
+
+// main.exe bench [file...]. 分词使用给出的文本文件, 默认 ./words/23.txt
+int bench(int argc, char* argv[]) {
+	bench_config_t cfg = { setting("YOUDAO_BENCH_WARMUP", BENCH_WARMUP), setting("YOUDAO_BENCH_REPS", BENCH_REPS),
+	                       setting("YOUDAO_BENCH_MIN_MS", BENCH_MIN_NS / 1000000) * 1000000 };
+	char name[MAX_PATH + 16];
+
+	int failed = MD5SelfTest();
+	if (failed) {
+		log_err("MD5 self-test failed on RFC 1321 vector %d", failed);
+		return EXIT_FAILURE;
+	}
+	if (prepare(db, SQL_QUERY, &s_query) ||
+	        cache_init(&s_known, setting("YOUDAO_CACHE_BYTES", CACHE_BYTES)))
+		return EXIT_FAILURE;
+	for (int i = 2; i < argc || i == 2; i++) {
+		const char* file = i < argc ? argv[i] : "./words/23.txt";
+		FILE* f = fopen(file, "rb");
+		if (f == NULL) {
+			log_warn("Skip collect on %s: %s", file, clean_errno());
+			continue;
+		}
+		rapidstring content;
+		char buf[1 << 16];
+		size_t n;
+		rs_init(&content);
+		while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+			rs_cat_n(&content, buf, n);
+		fclose(f);
+		size_t size = rs_len(&content);
+		const char* base = strrchr(file, '/');
+		snprintf(name, sizeof(name), "collect/%s", base ? base + 1 : file);
+		bench_run(&cfg, name, bench_collect, (void*)file, size);
+		snprintf(name, sizeof(name), "md5/file/%s", base ? base + 1 : file);
+		bench_run(&cfg, name, bench_md5_file, &content, size);
+		rs_free(&content);
+	}
+	cache_free(&s_known);
+	sqlite3_finalize(s_query);
+
+	char sign[MAX_PATH];
+	snprintf(sign, sizeof(sign), "%s%s%d%s", API_KEY, "hope", 1577810414, API_SECRET);
+	bench_run(&cfg, "md5/sign", bench_md5, sign, strlen(sign));
+	snprintf(name, sizeof(name), "md5mb/sign/x%d", MD5MB_LANES);
+	bench_run(&cfg, name, bench_md5mb, sign, strlen(sign));
+	bench_run(&cfg, "sign_batch", bench_sign_batch, "hope", 0);
+	bench_run(&cfg, "url", bench_url, "hope", 0);
+	bench_run(&cfg, "cjson_parse", bench_cjson, (void*)BENCH_RESPONSE, sizeof(BENCH_RESPONSE) - 1);
+
+	static const size_t sizes[] = { 1, 16, 256, 4096 };
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		snprintf(name, sizeof(name), "rs_cat/%zu", sizes[i]);
+		bench_run(&cfg, name, bench_rs_cat, (void*)&sizes[i], sizes[i] * 1024);
+	}
+
+	char chunk[1025];
+	memset(chunk, 'a', 1024);
+	chunk[1024] = 0;
+	bench_run(&cfg, "indexof/miss", bench_indexof, chunk, 1024);
+	memcpy(chunk + 1019, "0\r\n\r\n", 5);
+	bench_run(&cfg, "indexof/hit", bench_indexof, chunk, 1024);
+
+	// 写入单独的临时数据库, 设置与 database() 相同
+	static const char* bench_db = "bench.db";
+	bench_insert_t b = { 0 };
+	remove(bench_db);
+	if (sqlite3_open(bench_db, &b.db) == SQLITE_OK) {
+		char sync[64];
+		const char* mode = getenv("YOUDAO_SYNCHRONOUS");
+		snprintf(sync, sizeof(sync), "PRAGMA synchronous = %s", mode && *mode ? mode : DB_SYNCHRONOUS);
+		sqlite3_exec(b.db, "PRAGMA journal_mode = WAL", 0, 0, 0);
+		sqlite3_exec(b.db, sync, 0, 0, 0);
+		sqlite3_exec(b.db, SQL_CREATE_TABLE, 0, 0, 0);
+		sqlite3_exec(b.db, SQL_CREATE_INDEX, 0, 0, 0);
+		if (prepare(b.db, SQL_INSERT, &b.s) == 0) {
+			bench_run(&cfg, "insert_sql/autocommit", bench_insert, &b, 0);
+			b.transaction = 1;
+			bench_run(&cfg, "insert_sql/transaction", bench_insert, &b, 0);
+			sqlite3_finalize(b.s);
+		}
+	}
+	sqlite3_close(b.db);
+	remove("bench.db");
+	remove("bench.db-wal");
+	remove("bench.db-shm");
+	return EXIT_SUCCESS;
+}
+int print_completion(const char* key, size_t len, uint32_t index, void* ctx) {
+	(void)index;
+	(void)ctx;
+	printf("%.*s\n", (int)len, key);
+	return 0;
+}
 
-int main() {
+int64_t writer_depth(void* ctx) {
+	return (int64_t)mpsc_size(ctx);
+}
+#if ALLOC_ACCOUNTING
+int64_t alloc_gauge(void* ctx) {
+	return (int64_t)alloc_live((int)(intptr_t)ctx);
+}
+#endif
+void metrics_setup(void) {
+	metrics_init(&s_metrics);
+	s_m.tokenized = metrics_counter(&s_metrics, "youdao_words_tokenized_total", "Words read from the input text.");
+	s_m.cache_hits = metrics_counter(&s_metrics, "youdao_cache_hits_total", "dic lookup cache hits.");
+	s_m.cache_misses = metrics_counter(&s_metrics, "youdao_cache_misses_total", "dic lookup cache misses.");
+	s_m.in_flight = metrics_gauge(&s_metrics, "youdao_requests_in_flight", "Youdao API requests in progress.");
+	s_m.bytes_received = metrics_counter(&s_metrics, "youdao_received_bytes_total", "Bytes received from the Youdao API.");
+	s_m.api_errors = metrics_label(&s_metrics, METRIC_COUNTER, "youdao_api_errors_total",
+	                               "Youdao API responses with a non-zero errorCode.", "code");
+	s_m.batch_rows = metrics_histogram(&s_metrics, "youdao_insert_batch_rows", "Rows per committed transaction.",
+	                                   s_batch_bounds, sizeof(s_batch_bounds) / sizeof(s_batch_bounds[0]));
+	s_m.queue_depth = metrics_label(&s_metrics, METRIC_GAUGE, "youdao_queue_depth", "Items waiting in a queue.", "queue");
+	metric_t* writer = metrics_labeled(&s_metrics, s_m.queue_depth, "writer");
+	if (writer) {
+		writer->fn = writer_depth;
+		writer->ctx = &s_writer.queue;
+	}
+#if ALLOC_ACCOUNTING
+	metric_t* live = metrics_label(&s_metrics, METRIC_GAUGE, "youdao_alloc_live_bytes", "Bytes allocated and not yet freed.",
+	                               "subsystem");
+	for (int i = 0; i < ALLOC_SUBSYSTEMS; i++) {
+		metric_t* r = metrics_labeled(&s_metrics, live, s_alloc_names[i]);
+		if (r) {
+			r->fn = alloc_gauge;
+			r->ctx = (void*)(intptr_t)i;
+		}
+	}
+#endif
+}
+// 设置了端口时在后台提供 /metrics
+void metrics_start(void) {
+	uint16_t port = (uint16_t)setting("YOUDAO_METRICS_PORT", METRICS_PORT);
+	if (port > 0 && metrics_listen(&s_metrics, port) == 0)
+		log_info("Serving metrics on http://127.0.0.1:%u/metrics.", port);
+}
+
+int main(int argc, char* argv[]) {
 #if defined(_WIN32)
 	WSADATA d;
 	if (WSAStartup(MAKEWORD(2, 2), &d)) {
@@ -580,16 +1901,233 @@ int main() {
 	}
 #endif
 
+#if ALLOC_ACCOUNTING
+	cJSON_InitHooks(&alloc_cjson_hooks);
+#endif
+	histo_init(&s_histo, s_stage_names, STAGES);
+	trace_init(&s_trace, (int)setting("YOUDAO_TRACE", TRACE));
+	metrics_setup();
+
 	db = database();
 
 	table(db);
 
-	if (sqlite3_prepare_v2(db, SQL_QUERY, -1, &s_query, NULL)) {
-		fprintf(stderr, "error: Prepare stmt stmt_insert_ failed, %s\n", sqlite3_errmsg(db));
+	// main.exe migrate
+	if (argc > 1 && strcmp(argv[1], "migrate") == 0) {
+		int rc = migrate(db);
+		sqlite3_close(db);
+		return rc;
+	}
+
+	// main.exe image <file>
+	if (argc > 2 && strcmp(argv[1], "image") == 0) {
+		uint64_t t_start = _linux_get_time_ms();
+		long count = image_export(db, argv[2]);
+		sqlite3_close(db);
+		if (count < 0)
+			return EXIT_FAILURE;
+		log_info("Exported %ld words to %s in %llu ms.", count, argv[2],
+		         (unsigned long long)(_linux_get_time_ms() - t_start));
+		return EXIT_SUCCESS;
+	}
+
+	// main.exe kindle <dir> [threads]
+	if (argc > 2 && strcmp(argv[1], "kindle") == 0) {
+		uint64_t t_start = _linux_get_time_ms();
+		long count = kindle_export(db, argv[2], argc > 3 ? atoi(argv[3]) : 0);
+		sqlite3_close(db);
+		if (count < 0)
+			return EXIT_FAILURE;
+		log_info("Exported %ld words to %s in %llu ms.", count, argv[2],
+		         (unsigned long long)(_linux_get_time_ms() - t_start));
+		return EXIT_SUCCESS;
+	}
+
+	// main.exe stardict <dir>
+	if (argc > 2 && strcmp(argv[1], "stardict") == 0) {
+		uint64_t t_start = _linux_get_time_ms();
+		long count = stardict_export(db, argv[2], (int)setting("YOUDAO_STARDICT_SYN", 1),
+		                             (int)setting("YOUDAO_STARDICT_DICTZIP", 1));
+		sqlite3_close(db);
+		if (count < 0)
+			return EXIT_FAILURE;
+		log_info("Exported %ld words to %s in %llu ms.", count, argv[2],
+		         (unsigned long long)(_linux_get_time_ms() - t_start));
+		return EXIT_SUCCESS;
+	}
+
+	// main.exe lookup <file> <word>...
+	if (argc > 3 && strcmp(argv[1], "lookup") == 0) {
+		sqlite3_close(db);
+		image_t img;
+		if (image_open(&img, argv[2])) {
+			log_err("[ERROR]: Can't load image %s", argv[2]);
+			return EXIT_FAILURE;
+		}
+		for (int i = 3; i < argc; i++) {
+			size_t len;
+			const char* definition = image_lookup(&img, argv[i], strlen(argv[i]), &len);
+			if (definition)
+				printf("%s\n%.*s\n", argv[i], (int)len, definition);
+			else
+				log_warn("%s not found.", argv[i]);
+		}
+		image_close(&img);
+		return EXIT_SUCCESS;
+	}
+
+	// main.exe complete <file> <prefix> [limit]
+	if (argc > 3 && strcmp(argv[1], "complete") == 0) {
+		sqlite3_close(db);
+		image_t img;
+		if (image_open(&img, argv[2])) {
+			log_err("[ERROR]: Can't load image %s", argv[2]);
+			return EXIT_FAILURE;
+		}
+		image_complete(&img, argv[3], strlen(argv[3]), argc > 4 ? atoi(argv[4]) : 10, print_completion, NULL);
+		image_close(&img);
+		return EXIT_SUCCESS;
+	}
+
+	// main.exe suggest <word>...
+	if (argc > 2 && strcmp(argv[1], "suggest") == 0) {
+		symspell_t spell;
+		uint64_t t_start = _linux_get_time_ms();
+		if (spell_index(db, &spell)) {
+			sqlite3_close(db);
+			return EXIT_FAILURE;
+		}
+		log_info("Indexed %u words in %llu ms.", spell.count,
+		         (unsigned long long)(_linux_get_time_ms() - t_start));
+		for (int i = 2; i < argc; i++) {
+			symspell_suggestion_t found[10];
+			size_t n = symspell_lookup(&spell, argv[i], strlen(argv[i]), SYMSPELL_MAX_DISTANCE, found, 10);
+			printf("%s:", argv[i]);
+			for (size_t j = 0; j < n; j++) {
+				size_t len;
+				const char* word = symspell_word(&spell, found[j].word, &len);
+				printf(" %.*s(%d)", (int)len, word, found[j].distance);
+			}
+			printf("\n");
+		}
+		symspell_free(&spell);
+		sqlite3_close(db);
+		return EXIT_SUCCESS;
+	}
+
+	// main.exe serve [port]
+	if (argc > 1 && strcmp(argv[1], "serve") == 0) {
+		static const server_ops_t ops = { snapshot_lookup, snapshot_enter, snapshot_leave };
+		static snapshot_t snapshot;
+		logger_start((int)setting("YOUDAO_LOG_LEVEL", LOG_LEVEL_DEFAULT));
+		dict_t* dict = malloc(sizeof(dict_t));
+		uint64_t t_start = _linux_get_time_ms();
+		int rc = dict_load(db, dict);
+		sqlite3_close(db);
+		if (rc)
+			return EXIT_FAILURE;
+		uint16_t port = argc > 2 ? (uint16_t)atoi(argv[2]) : SERVER_PORT;
+		log_info("Loaded %u words in %llu ms, listening on 127.0.0.1:%u.", dict->count,
+		         (unsigned long long)(_linux_get_time_ms() - t_start), port);
+
+		rcu_init(&snapshot.rcu, dict);
+		snapshot.reader = rcu_register(&snapshot.rcu);
+		snapshot.interval_ms = setting("YOUDAO_RELOAD_MS", RELOAD_MS);
+		if (snapshot.interval_ms > 0)
+			pthread_create(&snapshot.thread, NULL, snapshot_run, &snapshot);
+		rc = server_run(port, &ops, &snapshot);
+		if (snapshot.interval_ms > 0) {
+			// server_run 出错返回时也要让重建线程退出
+			s_server_stop = 1;
+			pthread_join(snapshot.thread, NULL);
+		}
+		dict = atomic_load(&snapshot.rcu.ptr);
+		dict_free(dict);
+		free(dict);
+		return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	// main.exe loadtest [port] [connections] [requests] [depth]
+	if (argc > 1 && strcmp(argv[1], "loadtest") == 0) {
+		dict_t dict;
+		int rc = dict_load(db, &dict);
+		sqlite3_close(db);
+		if (rc)
+			return EXIT_FAILURE;
+		const char** keys = malloc((dict.count + 1) * sizeof(char*));
+		size_t* lens = malloc((dict.count + 1) * sizeof(size_t));
+		for (uint32_t i = 0; i < dict.count; i++)
+			keys[i] = dict_key(&dict, i, &lens[i]);
+		rc = loadtest(argc > 2 ? (uint16_t)atoi(argv[2]) : SERVER_PORT,
+		              argc > 3 ? (size_t)atoi(argv[3]) : 4,
+		              argc > 4 ? (size_t)atoi(argv[4]) : 100000,
+		              argc > 5 ? (size_t)atoi(argv[5]) : 1,
+		              keys, lens, dict.count);
+		free(keys);
+		free(lens);
+		dict_free(&dict);
+		return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	// main.exe bench [file...]
+	if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+		int rc = bench(argc, argv);
+		sqlite3_close(db);
+		return rc;
+	}
+
+	// main.exe define <word>...
+	if (argc > 2 && strcmp(argv[1], "define") == 0) {
+		cache_stats_t stats;
+		rapidstring out;
+		if (prepare(db, SQL_DEFINITION, &s_definition) ||
+		        cache_init(&s_cache, setting("YOUDAO_CACHE_BYTES", CACHE_BYTES))) {
+			sqlite3_close(db);
+			return EXIT_FAILURE;
+		}
+		rs_init(&out);
+		for (int i = 2; i < argc; i++) {
+			rs_clear(&out);
+			if (definition_sql(db, argv[i], s_definition, &s_cache, &out) == 1)
+				printf("%s\n%s\n", argv[i], rs_data(&out));
+			else
+				log_warn("%s not found.", argv[i]);
+		}
+		cache_stats(&s_cache, &stats);
+		log_info("Cache: %llu hits, %llu misses.", (unsigned long long)stats.hits, (unsigned long long)stats.misses);
+		rs_free(&out);
+		cache_free(&s_cache);
+		sqlite3_finalize(s_definition);
+		sqlite3_close(db);
+		return EXIT_SUCCESS;
+	}
+
+	// main.exe import <file.ndjson> [threads]
+	if (argc > 2 && strcmp(argv[1], "import") == 0) {
+		logger_start((int)setting("YOUDAO_LOG_LEVEL", LOG_LEVEL_DEFAULT));
+		metrics_start();
+		int rc = import(argv[2], argc > 3 ? atoi(argv[3]) : 0);
+		metrics_close(&s_metrics);
+		sqlite3_close(db);
+		return rc;
+	}
+
+	if (prepare(db, SQL_QUERY, &s_query) ||
+	        cache_init(&s_known, setting("YOUDAO_CACHE_BYTES", CACHE_BYTES))) {
+		return EXIT_FAILURE;
+	}
+	// 拼写纠正: 与已有单词只差一两个字母的单词不再请求
+	int spell_distance = (int)setting("YOUDAO_SPELL_DISTANCE", SPELL_DISTANCE);
+	symspell_t spell;
+	if (spell_distance > 0 && spell_index(db, &spell))
+		spell_distance = 0;
+	// 请求签名依赖 MD5, 结果不对时所有请求都会失败
+	if (MD5SelfTest()) {
+		fprintf(stderr, "error: MD5 self-test failed\n");
 		return EXIT_FAILURE;
 	}
-	if (sqlite3_prepare_v2(db, SQL_INSERT, -1, &s_insert, NULL)) {
-		fprintf(stderr, "error: Prepare stmt stmt_insert_ failed, %s\n", sqlite3_errmsg(db));
+	if (writer_start(&s_writer)) {
+		fprintf(stderr, "error: Start writer thread failed\n");
 		return EXIT_FAILURE;
 	}
 
@@ -603,22 +2141,70 @@ int main() {
 
 	// printf("%s %s\n", address_buf, service_buf);
 
-	list_head_t* word_list = collect();
+#ifdef SIGUSR1
+	signal(SIGUSR1, on_histo_signal);
+#endif
+	logger_start((int)setting("YOUDAO_LOG_LEVEL", LOG_LEVEL_DEFAULT));
+	metrics_start();
+	trace_thread_name(&s_trace, "main");
+	list_head_t* word_list = collect("./words/23.txt");
 	word_t *pos, *tmp;
 	list_for_each_entry_safe(pos, tmp, word_list, list, word_t) {
+		if (s_histo_dump) {
+			s_histo_dump = 0;
+			histo_report(&s_histo, stdout);
+#if ALLOC_ACCOUNTING
+			alloc_report(stdout);
+#endif
+		}
 
-		int rc = query_sql(db, pos->buf, s_query);
-		if (!rc) {
-
-			printf("Processing: %s\n", pos->buf);
+		trace_begin(&s_trace, "word", pos->buf);
+		trace_begin(&s_trace, "query_sql", pos->buf);
+		int rc = exists_sql(db, pos->buf, s_query, &s_known);
+		trace_end(&s_trace, "query_sql");
+		size_t len;
+		const char* correct = NULL;
+		if (!rc && spell_distance > 0 && (correct = spell_correct(&spell, pos->buf, spell_distance, &len))) {
+			log_info("Corrected: %s -> %.*s", pos->buf, (int)len, correct);
+		} else if (!rc) {
+
+			log_info("Processing: %s", pos->buf);
 			query(pos->buf);
 		} else {
 			//printf("Processed: %s\n", pos->buf);
 		}
+		trace_end(&s_trace, "word");
+		// 纠正过的单词没有写入 dic, 它的词形也不写入 inflections
+		if (correct == NULL && !rs_empty(&pos->forms))
+			writer_push_forms(&s_writer, pos->buf, rs_data(&pos->forms), rs_len(&pos->forms));
 		list_del(&pos->list);
+		rs_free(&pos->forms);
 		free(pos->buf);
 		free(pos);
 	}
+	writer_stop(&s_writer);
+	metrics_close(&s_metrics);
+	if (trace_enabled(&s_trace)) {
+		long events = trace_write(&s_trace, TRACE_FILE);
+		if (events >= 0)
+			log_info("Wrote %ld trace events to %s.", events, TRACE_FILE);
+	}
+	// 先写出排队的日志, 统计表在最后
+	logger_stop();
+	histo_report(&s_histo, stdout);
+#if ALLOC_ACCOUNTING
+	alloc_report(stdout);
+#endif
+	if (spell_distance > 0)
+		symspell_free(&spell);
+	cache_stats_t stats;
+	cache_stats(&s_known, &stats);
+	log_info("Cache: %llu hits, %llu misses, %llu evictions, %zu entries, %zu bytes.",
+	         (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+	         (unsigned long long)stats.evictions, stats.entries, stats.bytes);
+	cache_free(&s_known);
+	sqlite3_finalize(s_query);
+	sqlite3_close(db);
 	//query();
 	//query("word");
 #if defined(_WIN32)
@@ -0,0 +1,276 @@
+#ifndef MD5MB_H__
+#define MD5MB_H__
+
+/*
+ * Multi-buffer MD5: hashes several independent messages at once, one
+ * message per 32-bit SIMD lane (8 with AVX2, 4 with SSE2, and 4 plain
+ * lanes the compiler may vectorize elsewhere). MD5 is a serial chain of
+ * dependent adds and rotates within one message, so a single hash leaves
+ * most of the core idle; running one message per lane fills it.
+ *
+ * Messages in a group may differ in length. Every lane is fed its own
+ * padded blocks and its digest is taken after its last block; lanes that
+ * finish early keep computing on zero blocks whose result is ignored.
+ *
+ * md5_hex() encodes a digest through a 256-entry table, two characters per
+ * byte, in the upper case the Youdao signature uses.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#    include <immintrin.h>
+#    define MD5MB_LANES 8
+typedef __m256i md5mb_v;
+#    define MD5MB_ADD(x, y) _mm256_add_epi32(x, y)
+#    define MD5MB_AND(x, y) _mm256_and_si256(x, y)
+#    define MD5MB_OR(x, y) _mm256_or_si256(x, y)
+#    define MD5MB_XOR(x, y) _mm256_xor_si256(x, y)
+#    define MD5MB_SET1(x) _mm256_set1_epi32((int)(x))
+#    define MD5MB_ROTL(x, n) _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define MD5MB_LANES 4
+typedef __m128i md5mb_v;
+#    define MD5MB_ADD(x, y) _mm_add_epi32(x, y)
+#    define MD5MB_AND(x, y) _mm_and_si128(x, y)
+#    define MD5MB_OR(x, y) _mm_or_si128(x, y)
+#    define MD5MB_XOR(x, y) _mm_xor_si128(x, y)
+#    define MD5MB_SET1(x) _mm_set1_epi32((int)(x))
+#    define MD5MB_ROTL(x, n) _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - (n)))
+#else
+#    define MD5MB_LANES 4
+typedef struct {
+	uint32_t u[MD5MB_LANES];
+} md5mb_v;
+#    define MD5MB_LANEWISE(name, expr)                      \
+        static inline md5mb_v name(md5mb_v x, md5mb_v y)    \
+        {                                                   \
+            for (int i = 0; i < MD5MB_LANES; i++)           \
+                x.u[i] = expr;                              \
+            return x;                                       \
+        }
+MD5MB_LANEWISE(md5mb_add, x.u[i] + y.u[i])
+MD5MB_LANEWISE(md5mb_and, x.u[i] & y.u[i])
+MD5MB_LANEWISE(md5mb_or, x.u[i] | y.u[i])
+MD5MB_LANEWISE(md5mb_xor, x.u[i] ^ y.u[i])
+static inline md5mb_v md5mb_set1(uint32_t v)
+{
+	md5mb_v x;
+	for (int i = 0; i < MD5MB_LANES; i++)
+		x.u[i] = v;
+	return x;
+}
+static inline md5mb_v md5mb_rotl(md5mb_v x, int n)
+{
+	for (int i = 0; i < MD5MB_LANES; i++)
+		x.u[i] = (x.u[i] << n) | (x.u[i] >> (32 - n));
+	return x;
+}
+#    define MD5MB_ADD(x, y) md5mb_add(x, y)
+#    define MD5MB_AND(x, y) md5mb_and(x, y)
+#    define MD5MB_OR(x, y) md5mb_or(x, y)
+#    define MD5MB_XOR(x, y) md5mb_xor(x, y)
+#    define MD5MB_SET1(x) md5mb_set1(x)
+#    define MD5MB_ROTL(x, n) md5mb_rotl(x, n)
+#endif
+
+// 消息块: 按字 (w[j]) 排列, 每个字中各通道一个
+typedef union md5mb_block {
+	md5mb_v v[16];
+	uint32_t u[16][MD5MB_LANES];
+} md5mb_block_t;
+
+#define MD5MB_F(x, y, z) MD5MB_XOR(z, MD5MB_AND(x, MD5MB_XOR(y, z)))
+#define MD5MB_G(x, y, z) MD5MB_XOR(y, MD5MB_AND(z, MD5MB_XOR(x, y)))
+#define MD5MB_H(x, y, z) MD5MB_XOR(MD5MB_XOR(x, y), z)
+#define MD5MB_I(x, y, z) MD5MB_XOR(y, MD5MB_OR(x, MD5MB_XOR(z, MD5MB_SET1(0xffffffffu))))
+
+#define MD5MB_STEP(f, a, b, c, d, x, s, t) \
+    a = MD5MB_ADD(b, MD5MB_ROTL(MD5MB_ADD(MD5MB_ADD(a, f(b, c, d)), MD5MB_ADD(x, MD5MB_SET1(t))), s))
+
+static inline void md5mb_transform(md5mb_v* state, const md5mb_v* w)
+{
+	md5mb_v a = state[0], b = state[1], c = state[2], d = state[3];
+
+	MD5MB_STEP(MD5MB_F, a, b, c, d, w[0], 7, 0xd76aa478);
+	MD5MB_STEP(MD5MB_F, d, a, b, c, w[1], 12, 0xe8c7b756);
+	MD5MB_STEP(MD5MB_F, c, d, a, b, w[2], 17, 0x242070db);
+	MD5MB_STEP(MD5MB_F, b, c, d, a, w[3], 22, 0xc1bdceee);
+	MD5MB_STEP(MD5MB_F, a, b, c, d, w[4], 7, 0xf57c0faf);
+	MD5MB_STEP(MD5MB_F, d, a, b, c, w[5], 12, 0x4787c62a);
+	MD5MB_STEP(MD5MB_F, c, d, a, b, w[6], 17, 0xa8304613);
+	MD5MB_STEP(MD5MB_F, b, c, d, a, w[7], 22, 0xfd469501);
+	MD5MB_STEP(MD5MB_F, a, b, c, d, w[8], 7, 0x698098d8);
+	MD5MB_STEP(MD5MB_F, d, a, b, c, w[9], 12, 0x8b44f7af);
+	MD5MB_STEP(MD5MB_F, c, d, a, b, w[10], 17, 0xffff5bb1);
+	MD5MB_STEP(MD5MB_F, b, c, d, a, w[11], 22, 0x895cd7be);
+	MD5MB_STEP(MD5MB_F, a, b, c, d, w[12], 7, 0x6b901122);
+	MD5MB_STEP(MD5MB_F, d, a, b, c, w[13], 12, 0xfd987193);
+	MD5MB_STEP(MD5MB_F, c, d, a, b, w[14], 17, 0xa679438e);
+	MD5MB_STEP(MD5MB_F, b, c, d, a, w[15], 22, 0x49b40821);
+
+	MD5MB_STEP(MD5MB_G, a, b, c, d, w[1], 5, 0xf61e2562);
+	MD5MB_STEP(MD5MB_G, d, a, b, c, w[6], 9, 0xc040b340);
+	MD5MB_STEP(MD5MB_G, c, d, a, b, w[11], 14, 0x265e5a51);
+	MD5MB_STEP(MD5MB_G, b, c, d, a, w[0], 20, 0xe9b6c7aa);
+	MD5MB_STEP(MD5MB_G, a, b, c, d, w[5], 5, 0xd62f105d);
+	MD5MB_STEP(MD5MB_G, d, a, b, c, w[10], 9, 0x02441453);
+	MD5MB_STEP(MD5MB_G, c, d, a, b, w[15], 14, 0xd8a1e681);
+	MD5MB_STEP(MD5MB_G, b, c, d, a, w[4], 20, 0xe7d3fbc8);
+	MD5MB_STEP(MD5MB_G, a, b, c, d, w[9], 5, 0x21e1cde6);
+	MD5MB_STEP(MD5MB_G, d, a, b, c, w[14], 9, 0xc33707d6);
+	MD5MB_STEP(MD5MB_G, c, d, a, b, w[3], 14, 0xf4d50d87);
+	MD5MB_STEP(MD5MB_G, b, c, d, a, w[8], 20, 0x455a14ed);
+	MD5MB_STEP(MD5MB_G, a, b, c, d, w[13], 5, 0xa9e3e905);
+	MD5MB_STEP(MD5MB_G, d, a, b, c, w[2], 9, 0xfcefa3f8);
+	MD5MB_STEP(MD5MB_G, c, d, a, b, w[7], 14, 0x676f02d9);
+	MD5MB_STEP(MD5MB_G, b, c, d, a, w[12], 20, 0x8d2a4c8a);
+
+	MD5MB_STEP(MD5MB_H, a, b, c, d, w[5], 4, 0xfffa3942);
+	MD5MB_STEP(MD5MB_H, d, a, b, c, w[8], 11, 0x8771f681);
+	MD5MB_STEP(MD5MB_H, c, d, a, b, w[11], 16, 0x6d9d6122);
+	MD5MB_STEP(MD5MB_H, b, c, d, a, w[14], 23, 0xfde5380c);
+	MD5MB_STEP(MD5MB_H, a, b, c, d, w[1], 4, 0xa4beea44);
+	MD5MB_STEP(MD5MB_H, d, a, b, c, w[4], 11, 0x4bdecfa9);
+	MD5MB_STEP(MD5MB_H, c, d, a, b, w[7], 16, 0xf6bb4b60);
+	MD5MB_STEP(MD5MB_H, b, c, d, a, w[10], 23, 0xbebfbc70);
+	MD5MB_STEP(MD5MB_H, a, b, c, d, w[13], 4, 0x289b7ec6);
+	MD5MB_STEP(MD5MB_H, d, a, b, c, w[0], 11, 0xeaa127fa);
+	MD5MB_STEP(MD5MB_H, c, d, a, b, w[3], 16, 0xd4ef3085);
+	MD5MB_STEP(MD5MB_H, b, c, d, a, w[6], 23, 0x04881d05);
+	MD5MB_STEP(MD5MB_H, a, b, c, d, w[9], 4, 0xd9d4d039);
+	MD5MB_STEP(MD5MB_H, d, a, b, c, w[12], 11, 0xe6db99e5);
+	MD5MB_STEP(MD5MB_H, c, d, a, b, w[15], 16, 0x1fa27cf8);
+	MD5MB_STEP(MD5MB_H, b, c, d, a, w[2], 23, 0xc4ac5665);
+
+	MD5MB_STEP(MD5MB_I, a, b, c, d, w[0], 6, 0xf4292244);
+	MD5MB_STEP(MD5MB_I, d, a, b, c, w[7], 10, 0x432aff97);
+	MD5MB_STEP(MD5MB_I, c, d, a, b, w[14], 15, 0xab9423a7);
+	MD5MB_STEP(MD5MB_I, b, c, d, a, w[5], 21, 0xfc93a039);
+	MD5MB_STEP(MD5MB_I, a, b, c, d, w[12], 6, 0x655b59c3);
+	MD5MB_STEP(MD5MB_I, d, a, b, c, w[3], 10, 0x8f0ccc92);
+	MD5MB_STEP(MD5MB_I, c, d, a, b, w[10], 15, 0xffeff47d);
+	MD5MB_STEP(MD5MB_I, b, c, d, a, w[1], 21, 0x85845dd1);
+	MD5MB_STEP(MD5MB_I, a, b, c, d, w[8], 6, 0x6fa87e4f);
+	MD5MB_STEP(MD5MB_I, d, a, b, c, w[15], 10, 0xfe2ce6e0);
+	MD5MB_STEP(MD5MB_I, c, d, a, b, w[6], 15, 0xa3014314);
+	MD5MB_STEP(MD5MB_I, b, c, d, a, w[13], 21, 0x4e0811a1);
+	MD5MB_STEP(MD5MB_I, a, b, c, d, w[4], 6, 0xf7537e82);
+	MD5MB_STEP(MD5MB_I, d, a, b, c, w[11], 10, 0xbd3af235);
+	MD5MB_STEP(MD5MB_I, c, d, a, b, w[2], 15, 0x2ad7d2bb);
+	MD5MB_STEP(MD5MB_I, b, c, d, a, w[9], 21, 0xeb86d391);
+	state[0] = MD5MB_ADD(state[0], a);
+	state[1] = MD5MB_ADD(state[1], b);
+	state[2] = MD5MB_ADD(state[2], c);
+	state[3] = MD5MB_ADD(state[3], d);
+}
+
+static inline uint32_t md5mb_le32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// 填充后的块数: 至少 1 个 0x80 和 8 字节长度
+static inline size_t md5mb_blocks(size_t len)
+{
+	return (len + 8) / 64 + 1;
+}
+
+// 把消息的第 index 个填充后的块写入 lane 通道
+static void md5mb_load(md5mb_block_t* blk, size_t lane, const uint8_t* msg, size_t len, size_t index)
+{
+	uint8_t tmp[64];
+	const uint8_t* p;
+	size_t offset = index * 64;
+
+	if (offset + 64 <= len) {
+		p = msg + offset;
+	} else {
+		size_t n = len > offset ? len - offset : 0;
+		memset(tmp, 0, sizeof(tmp));
+		if (n > 0)
+			memcpy(tmp, msg + offset, n);
+		if (len >= offset)
+			tmp[n] = 0x80;
+		if (index + 1 == md5mb_blocks(len)) {
+			uint64_t bits = (uint64_t)len << 3;
+			for (int i = 0; i < 8; i++)
+				tmp[56 + i] = (uint8_t)(bits >> (8 * i));
+		}
+		p = tmp;
+	}
+	for (int j = 0; j < 16; j++)
+		blk->u[j][lane] = md5mb_le32(p + 4 * j);
+}
+
+// 计算 n 条消息的摘要, 每 MD5MB_LANES 条一组并行
+static void md5mb(const uint8_t* const* msgs, const size_t* lens, size_t n, uint8_t (*digests)[16])
+{
+	md5mb_block_t blk;
+	union {
+		md5mb_v v[4];
+		uint32_t u[4][MD5MB_LANES];
+	} state;
+
+	for (size_t g = 0; g < n; g += MD5MB_LANES) {
+		size_t m = n - g < MD5MB_LANES ? n - g : MD5MB_LANES;
+		size_t blocks[MD5MB_LANES], max = 0;
+		for (size_t l = 0; l < m; l++) {
+			blocks[l] = md5mb_blocks(lens[g + l]);
+			if (blocks[l] > max)
+				max = blocks[l];
+		}
+		state.v[0] = MD5MB_SET1(0x67452301);
+		state.v[1] = MD5MB_SET1(0xefcdab89);
+		state.v[2] = MD5MB_SET1(0x98badcfe);
+		state.v[3] = MD5MB_SET1(0x10325476);
+		memset(&blk, 0, sizeof(blk));
+
+		for (size_t b = 0; b < max; b++) {
+			int done = 0;
+			for (size_t l = 0; l < m; l++) {
+				if (b < blocks[l])
+					md5mb_load(&blk, l, msgs[g + l], lens[g + l], b);
+				else
+					for (int j = 0; j < 16; j++)
+						blk.u[j][l] = 0;
+				done |= b + 1 == blocks[l];
+			}
+			md5mb_transform(state.v, blk.v);
+			if (!done)
+				continue;
+			for (size_t l = 0; l < m; l++) {
+				if (b + 1 != blocks[l])
+					continue;
+				for (int i = 0; i < 4; i++) {
+					uint32_t x = state.u[i][l];
+					digests[g + l][4 * i] = (uint8_t)x;
+					digests[g + l][4 * i + 1] = (uint8_t)(x >> 8);
+					digests[g + l][4 * i + 2] = (uint8_t)(x >> 16);
+					digests[g + l][4 * i + 3] = (uint8_t)(x >> 24);
+				}
+			}
+		}
+	}
+}
+
+static const char MD5_HEX[513] =
+	"000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+	"202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F"
+	"404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+	"606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+	"808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9F"
+	"A0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+	"C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+	"E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+static inline void md5_hex(const uint8_t* digest, char* out)
+{
+	for (int i = 0; i < 16; i++)
+		memcpy(out + 2 * i, MD5_HEX + 2 * digest[i], 2);
+	out[32] = 0;
+}
+
+#endif
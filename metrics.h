@@ -0,0 +1,344 @@
+#ifndef METRICS_H__
+#define METRICS_H__
+
+/*
+ * Metrics registry exposed in the Prometheus text format.
+ *
+ * Counters, gauges and histograms are registered once at startup and
+ * updated with single atomic operations from any thread. A counter or
+ * gauge may carry one label; metrics_labeled() finds or adds the child for a label
+ * value (under the registry lock, so keep it off hot paths). A gauge can
+ * instead be read through a callback when scraped, e.g. a queue's size.
+ * Histograms take integer observations into cumulative `le` buckets.
+ *
+ * metrics_listen() serves GET /metrics on 127.0.0.1 from a background
+ * thread, one short connection at a time.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "rapidstring.h"
+#include "server.h"
+
+#define METRICS_MAX 64
+#define METRICS_MAX_BUCKETS 16
+#define METRICS_MAX_LABEL 32
+#define METRICS_MAX_REQUEST 4096
+
+typedef enum {
+	METRIC_COUNTER,
+	METRIC_GAUGE,
+	METRIC_HISTOGRAM,
+} metric_type_t;
+
+typedef int64_t (*metric_fn)(void* ctx);
+
+typedef struct metric {
+	const char* name;
+	const char* help;
+	metric_type_t type;
+	// 标签名和值, 没有标签时 label 为 NULL
+	const char* label;
+	char value_label[METRICS_MAX_LABEL];
+	atomic_int_fast64_t value;
+	// 抓取时读取的仪表
+	metric_fn fn;
+	void* ctx;
+	// 直方图: 各桶的上界 (含), 以及落在各桶 (非累计) 和 +Inf 的次数
+	const uint64_t* bounds;
+	size_t nbounds;
+	atomic_uint_fast64_t buckets[METRICS_MAX_BUCKETS + 1];
+	atomic_uint_fast64_t sum;
+} metric_t;
+
+typedef struct metrics {
+	pthread_mutex_t lock;
+	metric_t items[METRICS_MAX];
+	atomic_size_t count;
+	server_socket_t listener;
+	atomic_int stop;
+	pthread_t thread;
+	int listening;
+} metrics_t;
+
+static inline void metrics_init(metrics_t* m)
+{
+	memset(m, 0, sizeof(*m));
+	pthread_mutex_init(&m->lock, NULL);
+}
+
+static metric_t* metrics_add(metrics_t* m, metric_type_t type, const char* name, const char* help)
+{
+	metric_t* r = NULL;
+	pthread_mutex_lock(&m->lock);
+	size_t n = atomic_load(&m->count);
+	if (n < METRICS_MAX) {
+		r = &m->items[n];
+		r->type = type;
+		r->name = name;
+		r->help = help;
+		atomic_store(&m->count, n + 1);
+	}
+	pthread_mutex_unlock(&m->lock);
+	return r;
+}
+
+static inline metric_t* metrics_counter(metrics_t* m, const char* name, const char* help)
+{
+	return metrics_add(m, METRIC_COUNTER, name, help);
+}
+
+static inline metric_t* metrics_gauge(metrics_t* m, const char* name, const char* help)
+{
+	return metrics_add(m, METRIC_GAUGE, name, help);
+}
+
+static inline metric_t* metrics_gauge_fn(metrics_t* m, const char* name, const char* help, metric_fn fn, void* ctx)
+{
+	metric_t* r = metrics_add(m, METRIC_GAUGE, name, help);
+	if (r) {
+		r->fn = fn;
+		r->ctx = ctx;
+	}
+	return r;
+}
+
+// bounds 升序, 最多 METRICS_MAX_BUCKETS 个, 需要一直有效
+static inline metric_t* metrics_histogram(metrics_t* m, const char* name, const char* help,
+                                          const uint64_t* bounds, size_t nbounds)
+{
+	metric_t* r = metrics_add(m, METRIC_HISTOGRAM, name, help);
+	if (r) {
+		r->bounds = bounds;
+		r->nbounds = nbounds < METRICS_MAX_BUCKETS ? nbounds : METRICS_MAX_BUCKETS;
+	}
+	return r;
+}
+
+// 带标签的计数器或仪表: 作为模板注册, 本身不输出, 用 metrics_labeled 取得各标签值
+static inline metric_t* metrics_label(metrics_t* m, metric_type_t type, const char* name, const char* help,
+                                      const char* label)
+{
+	metric_t* r = metrics_add(m, type, name, help);
+	if (r)
+		r->label = label;
+	return r;
+}
+
+// 找到或添加 base 标签值为 value 的子指标, 已满时返回 NULL
+static metric_t* metrics_labeled(metrics_t* m, metric_t* base, const char* value)
+{
+	metric_t* r = NULL;
+	pthread_mutex_lock(&m->lock);
+	size_t n = atomic_load(&m->count);
+	for (size_t i = 0; i < n; i++) {
+		metric_t* it = &m->items[i];
+		if (it != base && it->name == base->name && strcmp(it->value_label, value) == 0) {
+			r = it;
+			break;
+		}
+	}
+	if (r == NULL && n < METRICS_MAX) {
+		r = &m->items[n];
+		*r = (metric_t){ .name = base->name, .help = base->help, .type = base->type, .label = base->label };
+		snprintf(r->value_label, sizeof(r->value_label), "%s", value);
+		atomic_store(&m->count, n + 1);
+	}
+	pthread_mutex_unlock(&m->lock);
+	return r;
+}
+
+static inline void metric_add(metric_t* r, int64_t v)
+{
+	if (r)
+		atomic_fetch_add_explicit(&r->value, v, memory_order_relaxed);
+}
+
+static inline void metric_set(metric_t* r, int64_t v)
+{
+	if (r)
+		atomic_store_explicit(&r->value, v, memory_order_relaxed);
+}
+
+static inline void metric_observe(metric_t* r, uint64_t v)
+{
+	if (r == NULL)
+		return;
+	size_t i = 0;
+	while (i < r->nbounds && v > r->bounds[i])
+		i++;
+	atomic_fetch_add_explicit(&r->buckets[i], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&r->sum, v, memory_order_relaxed);
+}
+
+static void metrics_escape(rapidstring* s, const char* p)
+{
+	for (; *p; p++) {
+		if (*p == '\\' || *p == '"')
+			rs_cat_n(s, "\\", 1);
+		if (*p == '\n')
+			rs_cat(s, "\\n");
+		else
+			rs_cat_n(s, p, 1);
+	}
+}
+
+// 同名的指标放在一起, HELP 和 TYPE 只写一次
+static void metrics_render(metrics_t* m, rapidstring* s)
+{
+	static const char* types[] = { "counter", "gauge", "histogram" };
+	char buf[128];
+	size_t n = atomic_load(&m->count);
+
+	for (size_t i = 0; i < n; i++) {
+		const metric_t* first = &m->items[i];
+		size_t j;
+		for (j = 0; j < i && m->items[j].name != first->name; j++)
+			;
+		if (j < i)
+			continue;
+		snprintf(buf, sizeof(buf), "# HELP %s ", first->name);
+		rs_cat(s, buf);
+		rs_cat(s, first->help);
+		snprintf(buf, sizeof(buf), "\n# TYPE %s %s\n", first->name, types[first->type]);
+		rs_cat(s, buf);
+
+		for (j = i; j < n; j++) {
+			metric_t* r = &m->items[j];
+			if (r->name != first->name || (r->label && r->value_label[0] == 0))
+				continue;
+			if (r->type == METRIC_HISTOGRAM) {
+				uint64_t total = 0;
+				for (size_t b = 0; b <= r->nbounds; b++) {
+					total += atomic_load_explicit(&r->buckets[b], memory_order_relaxed);
+					if (b < r->nbounds)
+						snprintf(buf, sizeof(buf), "%s_bucket{le=\"%llu\"} %llu\n", r->name,
+						         (unsigned long long)r->bounds[b], (unsigned long long)total);
+					else
+						snprintf(buf, sizeof(buf), "%s_bucket{le=\"+Inf\"} %llu\n", r->name, (unsigned long long)total);
+					rs_cat(s, buf);
+				}
+				snprintf(buf, sizeof(buf), "%s_sum %llu\n%s_count %llu\n", r->name,
+				         (unsigned long long)atomic_load_explicit(&r->sum, memory_order_relaxed), r->name,
+				         (unsigned long long)total);
+				rs_cat(s, buf);
+				continue;
+			}
+			int64_t v = r->fn ? r->fn(r->ctx) : atomic_load_explicit(&r->value, memory_order_relaxed);
+			rs_cat(s, r->name);
+			if (r->label) {
+				rs_cat(s, "{");
+				rs_cat(s, r->label);
+				rs_cat(s, "=\"");
+				metrics_escape(s, r->value_label);
+				rs_cat(s, "\"}");
+			}
+			snprintf(buf, sizeof(buf), " %lld\n", (long long)v);
+			rs_cat(s, buf);
+		}
+	}
+}
+
+// 读取请求头, 只回答 GET /metrics
+static void metrics_serve(metrics_t* m, server_socket_t fd)
+{
+	char req[METRICS_MAX_REQUEST + 1];
+	size_t len = 0;
+	rapidstring body, out;
+	char head[256];
+
+	while (len < METRICS_MAX_REQUEST) {
+		fd_set set;
+		struct timeval tv = { 1, 0 };
+		FD_ZERO(&set);
+		FD_SET(fd, &set);
+		if (select((int)fd + 1, &set, NULL, NULL, &tv) <= 0)
+			return;
+		long n = recv(fd, req + len, (int)(METRICS_MAX_REQUEST - len), 0);
+		if (n <= 0)
+			return;
+		len += (size_t)n;
+		req[len] = 0;
+		if (strstr(req, "\r\n\r\n"))
+			break;
+	}
+	req[len] = 0;
+
+	rs_init(&body);
+	rs_init(&out);
+	int found = strncmp(req, "GET /metrics ", 13) == 0 || strncmp(req, "GET /metrics?", 13) == 0;
+	if (found)
+		metrics_render(m, &body);
+	else
+		rs_cat(&body, "not found\n");
+	snprintf(head, sizeof(head),
+	         "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+	         found ? "200 OK" : "404 Not Found", rs_len(&body));
+	rs_cat(&out, head);
+	rs_cat_n(&out, rs_data_c(&body), rs_len(&body));
+
+	const char* p = rs_data_c(&out);
+	size_t left = rs_len(&out);
+	while (left > 0) {
+		long n = send(fd, p, (int)left, 0);
+		if (n <= 0)
+			break;
+		p += n;
+		left -= (size_t)n;
+	}
+	rs_free(&body);
+	rs_free(&out);
+}
+
+static void* metrics_run(void* arg)
+{
+	metrics_t* m = arg;
+	while (!atomic_load(&m->stop)) {
+		fd_set set;
+		struct timeval tv = { 0, 200000 };
+		FD_ZERO(&set);
+		FD_SET(m->listener, &set);
+		if (select((int)m->listener + 1, &set, NULL, NULL, &tv) <= 0)
+			continue;
+		server_socket_t fd = accept(m->listener, NULL, NULL);
+		if (SERVER_INVALID(fd))
+			continue;
+		metrics_serve(m, fd);
+		server_close_socket(fd);
+	}
+	return NULL;
+}
+
+// 在 127.0.0.1:port 上提供 /metrics. 成功返回 0
+static int metrics_listen(metrics_t* m, uint16_t port)
+{
+	server_t s;
+	if (server_listen(&s, port)) {
+		fprintf(stderr, "error: Can't listen on 127.0.0.1:%u\n", port);
+		return -1;
+	}
+	m->listener = s.listener;
+	atomic_store(&m->stop, 0);
+	if (pthread_create(&m->thread, NULL, metrics_run, m)) {
+		server_close_socket(m->listener);
+		return -1;
+	}
+	m->listening = 1;
+	return 0;
+}
+
+static void metrics_close(metrics_t* m)
+{
+	if (!m->listening)
+		return;
+	atomic_store(&m->stop, 1);
+	pthread_join(m->thread, NULL);
+	server_close_socket(m->listener);
+	m->listening = 0;
+}
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef MPH_H__
+#define MPH_H__
+
+/*
+ * Minimal perfect hash over a fixed key set (hash and displace, CHD style).
+ *
+ * Keys are spread over n / MPH_BUCKET_SIZE buckets by one half of a 64 bit
+ * hash. Buckets are placed largest first: for each bucket the builder
+ * searches the smallest pilot value that sends every key of the bucket to a
+ * free slot of [0, n) through the other half of the hash. Looking a key up
+ * then takes one hash, one pilot read and one modulo, the caller verifies the
+ * key stored at the returned slot.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 平均每个桶的 key 数, 越大函数越小, 构建越慢
+#define MPH_BUCKET_SIZE 4
+// 单个桶尝试的 pilot 上限, 超过后换一个种子重建
+#define MPH_MAX_PILOT (1u << 24)
+#define MPH_MAX_ATTEMPTS 16
+
+typedef struct mph {
+	uint32_t n;
+	uint32_t buckets;
+	uint64_t seed;
+	// pilots[buckets], little-endian u32
+	const uint8_t* pilots;
+} mph_t;
+
+static inline uint64_t mph_mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static inline uint64_t mph_hash(const char* key, size_t len, uint64_t seed)
+{
+	uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+	const uint8_t* p = (const uint8_t*)key;
+
+	// 每次读取 8 字节, 剩余部分逐字节处理
+	while (len >= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		h = (h ^ mph_mix(v)) * 0x100000001b3ULL;
+		p += 8;
+		len -= 8;
+	}
+	uint64_t tail = 0;
+	for (size_t i = 0; i < len; i++)
+		tail |= (uint64_t)p[i] << (i * 8);
+	h = (h ^ mph_mix(tail ^ ((uint64_t)len << 56))) * 0x100000001b3ULL;
+	return mph_mix(h);
+}
+
+static inline uint32_t mph_bucket(uint64_t h, uint32_t buckets)
+{
+	return (uint32_t)((h >> 32) % buckets);
+}
+
+static inline uint32_t mph_position(uint64_t h, uint32_t pilot, uint32_t n)
+{
+	return (uint32_t)(((uint32_t)h ^ (uint32_t)mph_mix(pilot + 0x9e3779b97f4a7c15ULL)) % n);
+}
+
+static inline uint32_t mph_pilot(const mph_t* m, uint32_t bucket)
+{
+	const uint8_t* p = m->pilots + (size_t)bucket * 4;
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// 返回 key 的槽位. 不在集合中的 key 也会得到某个槽位, 需要调用者比较
+static inline uint32_t mph_lookup(const mph_t* m, const char* key, size_t len)
+{
+	uint64_t h = mph_hash(key, len, m->seed);
+	return mph_position(h, mph_pilot(m, mph_bucket(h, m->buckets)), m->n);
+}
+
+static int mph_build_seed(uint32_t n, const uint64_t* hashes, uint32_t buckets, uint32_t* pilots, uint32_t* slots)
+{
+	uint32_t* start = calloc((size_t)buckets + 1, sizeof(uint32_t));
+	uint32_t* members = malloc((size_t)n * sizeof(uint32_t));
+	uint32_t* order = malloc((size_t)buckets * sizeof(uint32_t));
+	uint8_t* taken = calloc(n, 1);
+	uint32_t* tried = malloc(n * sizeof(uint32_t));
+	uint32_t max_size = 0;
+	int rc = -1;
+
+	if (!start || !members || !order || !taken || !tried)
+		goto done;
+
+	// 按桶对 key 做计数排序
+	for (uint32_t i = 0; i < n; i++)
+		start[mph_bucket(hashes[i], buckets) + 1]++;
+	for (uint32_t b = 0; b < buckets; b++) {
+		if (start[b + 1] > max_size)
+			max_size = start[b + 1];
+		start[b + 1] += start[b];
+	}
+	{
+		uint32_t* fill = malloc((size_t)buckets * sizeof(uint32_t));
+		if (!fill)
+			goto done;
+		memcpy(fill, start, (size_t)buckets * sizeof(uint32_t));
+		for (uint32_t i = 0; i < n; i++)
+			members[fill[mph_bucket(hashes[i], buckets)]++] = i;
+		free(fill);
+	}
+
+	// 桶按大小降序处理
+	{
+		uint32_t* count = calloc((size_t)max_size + 2, sizeof(uint32_t));
+		if (!count)
+			goto done;
+		for (uint32_t b = 0; b < buckets; b++)
+			count[max_size - (start[b + 1] - start[b]) + 1]++;
+		for (uint32_t s = 0; s <= max_size; s++)
+			count[s + 1] += count[s];
+		for (uint32_t b = 0; b < buckets; b++)
+			order[count[max_size - (start[b + 1] - start[b])]++] = b;
+		free(count);
+	}
+
+	for (uint32_t o = 0; o < buckets; o++) {
+		uint32_t b = order[o];
+		uint32_t size = start[b + 1] - start[b];
+		const uint32_t* keys = members + start[b];
+		uint32_t pilot;
+
+		pilots[b] = 0;
+		if (size == 0)
+			continue;
+
+		for (pilot = 0; pilot < MPH_MAX_PILOT; pilot++) {
+			uint32_t k;
+			for (k = 0; k < size; k++) {
+				uint32_t pos = mph_position(hashes[keys[k]], pilot, n);
+				if (taken[pos])
+					break;
+				// 同一个桶内的 key 也不能冲突
+				taken[pos] = 1;
+				tried[k] = pos;
+			}
+			if (k == size)
+				break;
+			while (k > 0)
+				taken[tried[--k]] = 0;
+		}
+		if (pilot == MPH_MAX_PILOT)
+			goto done;
+
+		pilots[b] = pilot;
+		for (uint32_t k = 0; k < size; k++)
+			slots[tried[k]] = keys[k];
+	}
+	rc = 0;
+
+done:
+	free(start);
+	free(members);
+	free(order);
+	free(taken);
+	free(tried);
+	return rc;
+}
+
+// 为 n 个不同的 key 构建函数. 成功时 pilots 和 slots 由调用者释放,
+// slots[槽位] 为 key 在输入中的序号
+static int mph_build(uint32_t n, const char* const* keys, const size_t* lens,
+                     uint64_t* seed, uint32_t* buckets, uint32_t** pilots, uint32_t** slots)
+{
+	if (n == 0)
+		return -1;
+
+	*buckets = (n + MPH_BUCKET_SIZE - 1) / MPH_BUCKET_SIZE;
+	*pilots = malloc((size_t)*buckets * sizeof(uint32_t));
+	*slots = malloc((size_t)n * sizeof(uint32_t));
+	uint64_t* hashes = malloc((size_t)n * sizeof(uint64_t));
+	if (!*pilots || !*slots || !hashes)
+		goto error;
+
+	for (uint32_t attempt = 0; attempt < MPH_MAX_ATTEMPTS; attempt++) {
+		*seed = mph_mix(0x2545f4914f6cdd1dULL + attempt);
+		for (uint32_t i = 0; i < n; i++)
+			hashes[i] = mph_hash(keys[i], lens[i], *seed);
+		if (mph_build_seed(n, hashes, *buckets, *pilots, *slots) == 0) {
+			free(hashes);
+			return 0;
+		}
+	}
+
+error:
+	free(hashes);
+	free(*pilots);
+	free(*slots);
+	*pilots = NULL;
+	*slots = NULL;
+	return -1;
+}
+
+#endif
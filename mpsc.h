@@ -0,0 +1,139 @@
+#ifndef MPSC_H__
+#define MPSC_H__
+
+/*
+ * Bounded lock-free multi-producer single-consumer queue.
+ *
+ * Every cell carries a sequence number that tells producers whether the cell
+ * is free for position `pos` (sequence == pos) and tells the consumer whether
+ * it has been published (sequence == pos + 1). Producers claim positions with
+ * a CAS on tail, only the single consumer ever advances head.
+ * Capacity must be a power of two.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#    include <windows.h>
+#    define mpsc_yield() SwitchToThread()
+#    define mpsc_sleep_ms(ms) Sleep(ms)
+#else
+#    include <sched.h>
+#    include <time.h>
+#    define mpsc_yield() sched_yield()
+#    define mpsc_sleep_ms(ms) nanosleep(&(struct timespec){ 0, (ms)*1000000L }, NULL)
+#endif
+
+#define MPSC_CACHE_LINE 64
+
+typedef struct mpsc_cell {
+	atomic_size_t sequence;
+	void* data;
+} mpsc_cell_t;
+
+typedef struct mpsc {
+	mpsc_cell_t* cells;
+	size_t mask;
+	char pad0[MPSC_CACHE_LINE];
+	atomic_size_t tail;
+	char pad1[MPSC_CACHE_LINE];
+	atomic_size_t head;
+	atomic_int closed;
+} mpsc_t;
+
+static inline int mpsc_init(mpsc_t* q, size_t capacity)
+{
+	if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+		return -1;
+	q->cells = malloc(capacity * sizeof(mpsc_cell_t));
+	if (q->cells == NULL)
+		return -1;
+	for (size_t i = 0; i < capacity; i++)
+		atomic_init(&q->cells[i].sequence, i);
+	q->mask = capacity - 1;
+	atomic_init(&q->tail, 0);
+	atomic_init(&q->head, 0);
+	atomic_init(&q->closed, 0);
+	return 0;
+}
+
+static inline void mpsc_free(mpsc_t* q)
+{
+	free(q->cells);
+	q->cells = NULL;
+}
+
+/* Returns 0 on success, -1 when the queue is full. */
+static inline int mpsc_try_push(mpsc_t* q, void* data)
+{
+	size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	mpsc_cell_t* cell;
+
+	for (;;) {
+		cell = &q->cells[pos & q->mask];
+		size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+		intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+		if (dif == 0) {
+			if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+			        memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if (dif < 0) {
+			return -1;
+		} else {
+			pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+		}
+	}
+	cell->data = data;
+	atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+	return 0;
+}
+
+/* Blocks while the queue is full, so a slow consumer throttles producers. */
+static inline void mpsc_push(mpsc_t* q, void* data)
+{
+	for (unsigned spins = 0; mpsc_try_push(q, data) != 0; spins++) {
+		if (spins < 64)
+			mpsc_yield();
+		else
+			mpsc_sleep_ms(1);
+	}
+}
+
+/* Consumer only. Returns NULL when the queue is empty. */
+static inline void* mpsc_try_pop(mpsc_t* q)
+{
+	size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+	mpsc_cell_t* cell = &q->cells[pos & q->mask];
+	size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+
+	if ((intptr_t)seq - (intptr_t)(pos + 1) < 0)
+		return NULL;
+
+	void* data = cell->data;
+	atomic_store_explicit(&cell->sequence, pos + q->mask + 1, memory_order_release);
+	atomic_store_explicit(&q->head, pos + 1, memory_order_relaxed);
+	return data;
+}
+
+/* Approximate number of queued items, for monitoring. */
+static inline size_t mpsc_size(mpsc_t* q)
+{
+	size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	return tail > head ? tail - head : 0;
+}
+
+/* Producers must not push after closing. */
+static inline void mpsc_close(mpsc_t* q)
+{
+	atomic_store_explicit(&q->closed, 1, memory_order_release);
+}
+
+static inline int mpsc_closed(mpsc_t* q)
+{
+	return atomic_load_explicit(&q->closed, memory_order_acquire);
+}
+
+#endif
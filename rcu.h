@@ -0,0 +1,96 @@
+#ifndef RCU_H__
+#define RCU_H__
+
+/*
+ * Read-copy-update for a single shared pointer, epoch based.
+ *
+ * Readers announce the global epoch they entered with, read the pointer and
+ * use the object until rcu_read_unlock(); that is one store and one load, no
+ * locks and no read-modify-write. An updater swaps in the new object, bumps
+ * the epoch and waits until every reader that might still hold the old
+ * pointer (online with an older epoch) has left; then the old object can be
+ * freed. Updaters must be serialized by the caller.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(_WIN32)
+#    include <windows.h>
+#    define rcu_sleep_ms(ms) Sleep(ms)
+#else
+#    include <time.h>
+#    define rcu_sleep_ms(ms) nanosleep(&(struct timespec){ 0, (ms)*1000000L }, NULL)
+#endif
+
+#define RCU_MAX_READERS 64
+#define RCU_CACHE_LINE 64
+
+typedef struct rcu_reader {
+	// 进入时的全局纪元, 0 表示不在读临界区
+	atomic_uint_fast64_t epoch;
+	char pad[RCU_CACHE_LINE - sizeof(atomic_uint_fast64_t)];
+} rcu_reader_t;
+
+typedef struct rcu {
+	_Atomic(void*) ptr;
+	atomic_uint_fast64_t epoch;
+	atomic_uint readers_used;
+	rcu_reader_t readers[RCU_MAX_READERS];
+} rcu_t;
+
+static inline void rcu_init(rcu_t* r, void* ptr)
+{
+	atomic_init(&r->ptr, ptr);
+	atomic_init(&r->epoch, 1);
+	atomic_init(&r->readers_used, 0);
+	for (size_t i = 0; i < RCU_MAX_READERS; i++)
+		atomic_init(&r->readers[i].epoch, 0);
+}
+
+// 每个读线程调用一次. 读线程过多时返回 NULL
+static inline rcu_reader_t* rcu_register(rcu_t* r)
+{
+	unsigned i = atomic_fetch_add(&r->readers_used, 1);
+	return i < RCU_MAX_READERS ? &r->readers[i] : NULL;
+}
+
+static inline void* rcu_read_lock(rcu_t* r, rcu_reader_t* reader)
+{
+	// 顺序一致的存储保证更新者扫描时能看到本读者, 或者本读者能看到新指针
+	atomic_store(&reader->epoch, atomic_load(&r->epoch));
+	return atomic_load(&r->ptr);
+}
+
+static inline void rcu_read_unlock(rcu_reader_t* reader)
+{
+	atomic_store_explicit(&reader->epoch, 0, memory_order_release);
+}
+
+// 等待所有可能持有旧指针的读者离开临界区
+static inline void rcu_synchronize(rcu_t* r)
+{
+	uint_fast64_t target = atomic_fetch_add(&r->epoch, 1) + 1;
+	unsigned n = atomic_load(&r->readers_used);
+	if (n > RCU_MAX_READERS)
+		n = RCU_MAX_READERS;
+	for (unsigned i = 0; i < n; i++) {
+		for (;;) {
+			uint_fast64_t e = atomic_load(&r->readers[i].epoch);
+			if (e == 0 || e >= target)
+				break;
+			rcu_sleep_ms(1);
+		}
+	}
+}
+
+// 替换指针并等待宽限期结束, 返回的旧对象已不再被任何读者使用
+static inline void* rcu_replace(rcu_t* r, void* ptr)
+{
+	void* old = atomic_exchange(&r->ptr, ptr);
+	rcu_synchronize(r);
+	return old;
+}
+
+#endif
@@ -0,0 +1,772 @@
+#ifndef SERVER_H__
+#define SERVER_H__
+
+/*
+ * Local HTTP/1.1 lookup server and its load-test client.
+ *
+ *   GET  /lookup?q=word        {"key":"word","word":"..."}, 404 if missing
+ *   POST /lookup ["a","b"]     [{"key":"a","word":"..."},{"key":"b","word":null}]
+ *
+ * One thread serves every connection from an event loop, epoll on Linux and
+ * select() elsewhere. Connections are kept alive and pipelined requests are
+ * answered in order: every request already in the input buffer is handled
+ * before the combined responses are written with a single send(). A client
+ * that sends requests faster than it reads the responses is not read from
+ * while SERVER_OUT_HIGH bytes of responses are waiting, so its buffers stay
+ * bounded and other connections keep being served.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include "rapidstring.h"
+#include "cJSON/cJSON.h"
+
+#if defined(_WIN32)
+#    include <winsock2.h>
+#    include <ws2tcpip.h>
+#    define SERVER_WOULDBLOCK() (WSAGetLastError() == WSAEWOULDBLOCK)
+#    define SERVER_INVALID(fd) ((fd) == INVALID_SOCKET)
+typedef SOCKET server_socket_t;
+#else
+#    include <errno.h>
+#    include <fcntl.h>
+#    include <unistd.h>
+#    include <strings.h>
+#    include <sys/socket.h>
+#    include <netinet/in.h>
+#    include <netinet/tcp.h>
+#    include <arpa/inet.h>
+#    define SERVER_WOULDBLOCK() (errno == EAGAIN || errno == EWOULDBLOCK)
+#    define SERVER_INVALID(fd) ((fd) < 0)
+typedef int server_socket_t;
+#endif
+#if defined(__linux__)
+#    include <sys/epoll.h>
+#endif
+
+#define SERVER_PORT 8765
+// 请求头和请求体的上限, 超过时关闭连接
+#define SERVER_MAX_HEADER (16 * 1024)
+#define SERVER_MAX_BODY (1024 * 1024)
+#define SERVER_MAX_KEY 256
+#define SERVER_READ_SIZE (64 * 1024)
+// 未处理的请求或未发送的回复超过上限时暂停读取, 回复发送出去后继续
+#define SERVER_MAX_INPUT (SERVER_MAX_HEADER + SERVER_MAX_BODY)
+#define SERVER_OUT_HIGH (1024 * 1024)
+#define SERVER_MAX_EVENTS 256
+
+// 返回 key 的释义, 不存在时返回 NULL. 释义在下一次 leave 之前保持有效
+typedef const char* (*server_lookup_fn)(void* ctx, const char* key, size_t len, size_t* word_len);
+
+typedef struct server_ops {
+	server_lookup_fn lookup;
+	// 可选, 包围一批请求的处理, 例如进入和离开 RCU 读临界区
+	void (*enter)(void* ctx);
+	void (*leave)(void* ctx);
+} server_ops_t;
+
+typedef struct server_conn {
+	server_socket_t fd;
+	rapidstring in;
+	// in 中已处理的字节数
+	size_t in_pos;
+	rapidstring out;
+	// out 中已发送的字节数
+	size_t out_pos;
+	// 发送完后关闭
+	int closing;
+	// 当前在 epoll 中等待的事件
+	uint32_t events;
+} server_conn_t;
+
+typedef struct server {
+	server_socket_t listener;
+	const server_ops_t* ops;
+	void* ctx;
+} server_t;
+
+static volatile sig_atomic_t s_server_stop;
+
+static void server_on_signal(int sig)
+{
+	(void)sig;
+	s_server_stop = 1;
+}
+
+static inline uint64_t server_now_us(void)
+{
+#if defined(_WIN32)
+	LARGE_INTEGER f, c;
+	QueryPerformanceFrequency(&f);
+	QueryPerformanceCounter(&c);
+	return (uint64_t)(c.QuadPart / f.QuadPart * 1000000 + c.QuadPart % f.QuadPart * 1000000 / f.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#endif
+}
+
+static inline int server_nonblocking(server_socket_t fd)
+{
+#if defined(_WIN32)
+	u_long on = 1;
+	return ioctlsocket(fd, FIONBIO, &on);
+#else
+	int flags = fcntl(fd, F_GETFL, 0);
+	return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+// 小响应立即发送, 不等待 Nagle 合并
+static inline void server_nodelay(server_socket_t fd)
+{
+	int on = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+}
+
+static inline void server_close_socket(server_socket_t fd)
+{
+#if defined(_WIN32)
+	closesocket(fd);
+#else
+	close(fd);
+#endif
+}
+
+static void server_json_string(rapidstring* s, const char* p, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t start = 0;
+
+	rs_cat_n(s, "\"", 1);
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)p[i];
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+		rs_cat_n(s, p + start, i - start);
+		start = i + 1;
+		switch (c) {
+		case '"': rs_cat_n(s, "\\\"", 2); break;
+		case '\\': rs_cat_n(s, "\\\\", 2); break;
+		case '\n': rs_cat_n(s, "\\n", 2); break;
+		case '\r': rs_cat_n(s, "\\r", 2); break;
+		case '\t': rs_cat_n(s, "\\t", 2); break;
+		default: {
+			char u[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+			rs_cat_n(s, u, 6);
+		}
+		}
+	}
+	rs_cat_n(s, p + start, len - start);
+	rs_cat_n(s, "\"", 1);
+}
+
+static void server_json_entry(rapidstring* s, const char* key, size_t len, const char* word, size_t word_len)
+{
+	rs_cat_n(s, "{\"key\":", 7);
+	server_json_string(s, key, len);
+	rs_cat_n(s, ",\"word\":", 8);
+	if (word)
+		server_json_string(s, word, word_len);
+	else
+		rs_cat_n(s, "null", 4);
+	rs_cat_n(s, "}", 1);
+}
+
+static void server_respond(server_conn_t* c, int status, const char* body, size_t len)
+{
+	const char* reason = status == 200 ? "OK" : status == 400 ? "Bad Request" : status == 404 ? "Not Found"
+	                     : status == 405 ? "Method Not Allowed" : status == 413 ? "Payload Too Large" : "Error";
+	char head[192];
+	int n = snprintf(head, sizeof(head),
+	                 "HTTP/1.1 %d %s\r\nContent-Type: application/json; charset=utf-8\r\nContent-Length: %zu\r\n%s\r\n",
+	                 status, reason, len, c->closing ? "Connection: close\r\n" : "");
+	rs_cat_n(&c->out, head, (size_t)n);
+	rs_cat_n(&c->out, body, len);
+}
+
+static inline int server_hex(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+// 从查询字符串中解码参数 q, 返回长度, 没有或过长时返回 -1
+static long server_query_param(const char* query, size_t len, char* out, size_t out_size)
+{
+	const char* end = query + len;
+	for (const char* p = query; p < end;) {
+		const char* amp = memchr(p, '&', (size_t)(end - p));
+		if (amp == NULL)
+			amp = end;
+		if (amp - p >= 2 && p[0] == 'q' && p[1] == '=') {
+			size_t n = 0;
+			for (const char* v = p + 2; v < amp; v++) {
+				char c = *v;
+				if (c == '+') {
+					c = ' ';
+				} else if (c == '%' && amp - v >= 3 && server_hex(v[1]) >= 0 && server_hex(v[2]) >= 0) {
+					c = (char)(server_hex(v[1]) << 4 | server_hex(v[2]));
+					v += 2;
+				}
+				if (n == out_size)
+					return -1;
+				out[n++] = c;
+			}
+			return (long)n;
+		}
+		p = amp + 1;
+	}
+	return -1;
+}
+
+static void server_handle(server_t* s, server_conn_t* c, const char* method, size_t method_len,
+                          const char* target, size_t target_len, const char* body, size_t body_len)
+{
+	static const char not_found[] = "{\"error\":\"not found\"}";
+	const char* query = memchr(target, '?', target_len);
+	size_t path_len = query ? (size_t)(query - target) : target_len;
+
+	if (path_len != 7 || memcmp(target, "/lookup", 7) != 0) {
+		server_respond(c, 404, not_found, sizeof(not_found) - 1);
+		return;
+	}
+
+	rapidstring r;
+	rs_init(&r);
+	if (method_len == 3 && memcmp(method, "GET", 3) == 0) {
+		char key[SERVER_MAX_KEY];
+		long len = query ? server_query_param(query + 1, target_len - path_len - 1, key, sizeof(key)) : -1;
+		size_t word_len = 0;
+		const char* word = len > 0 ? s->ops->lookup(s->ctx, key, (size_t)len, &word_len) : NULL;
+		if (len <= 0) {
+			static const char missing[] = "{\"error\":\"missing q\"}";
+			server_respond(c, 400, missing, sizeof(missing) - 1);
+		} else {
+			server_json_entry(&r, key, (size_t)len, word, word_len);
+			server_respond(c, word ? 200 : 404, rs_data_c(&r), rs_len(&r));
+		}
+	} else if (method_len == 4 && memcmp(method, "POST", 4) == 0) {
+		// 请求体不以 \0 结尾, 复制一份再解析
+		char* text = malloc(body_len + 1);
+		memcpy(text, body, body_len);
+		text[body_len] = 0;
+		cJSON* json = cJSON_Parse(text);
+		free(text);
+		if (!cJSON_IsArray(json)) {
+			static const char bad[] = "{\"error\":\"expected an array of words\"}";
+			server_respond(c, 400, bad, sizeof(bad) - 1);
+		} else {
+			const cJSON* item;
+			int first = 1;
+			rs_cat_n(&r, "[", 1);
+			cJSON_ArrayForEach(item, json) {
+				if (!first)
+					rs_cat_n(&r, ",", 1);
+				first = 0;
+				if (!cJSON_IsString(item)) {
+					rs_cat_n(&r, "null", 4);
+					continue;
+				}
+				size_t len = strlen(item->valuestring), word_len = 0;
+				const char* word = s->ops->lookup(s->ctx, item->valuestring, len, &word_len);
+				server_json_entry(&r, item->valuestring, len, word, word_len);
+			}
+			rs_cat_n(&r, "]", 1);
+			server_respond(c, 200, rs_data_c(&r), rs_len(&r));
+		}
+		cJSON_Delete(json);
+	} else {
+		static const char bad[] = "{\"error\":\"method not allowed\"}";
+		server_respond(c, 405, bad, sizeof(bad) - 1);
+	}
+	rs_free(&r);
+}
+
+// 处理 in 中所有完整的请求. 返回 -1 表示请求有误, 回复后关闭连接
+static int server_process(server_t* s, server_conn_t* c)
+{
+	while (!c->closing) {
+		const char* p = rs_data_c(&c->in) + c->in_pos;
+		size_t avail = rs_len(&c->in) - c->in_pos;
+		size_t head_len = 0;
+
+		for (size_t i = 3; i < avail; i++) {
+			if (p[i] == '\n' && p[i - 1] == '\r' && p[i - 2] == '\n' && p[i - 3] == '\r') {
+				head_len = i + 1;
+				break;
+			}
+		}
+		if (head_len == 0) {
+			if (avail > SERVER_MAX_HEADER) {
+				c->closing = 1;
+				server_respond(c, 413, "", 0);
+				return -1;
+			}
+			break;
+		}
+
+		// 请求行: METHOD SP TARGET SP HTTP/1.x
+		const char* line_end = memchr(p, '\r', head_len);
+		const char* sp1 = memchr(p, ' ', (size_t)(line_end - p));
+		const char* sp2 = sp1 ? memchr(sp1 + 1, ' ', (size_t)(line_end - sp1 - 1)) : NULL;
+		if (sp2 == NULL || line_end - sp2 != 9 || memcmp(sp2 + 1, "HTTP/1.", 7) != 0) {
+			c->closing = 1;
+			server_respond(c, 400, "", 0);
+			return -1;
+		}
+		int keep_alive = sp2[8] == '1';
+		size_t body_len = 0;
+
+		for (const char* h = line_end + 2; h < p + head_len - 2;) {
+			const char* eol = memchr(h, '\r', (size_t)(p + head_len - h));
+			size_t n = (size_t)(eol - h);
+			if (n > 15 && strncasecmp(h, "Content-Length:", 15) == 0) {
+				body_len = (size_t)strtoull(h + 15, NULL, 10);
+			} else if (n > 11 && strncasecmp(h, "Connection:", 11) == 0) {
+				const char* v = h + 11;
+				while (*v == ' ')
+					v++;
+				if (strncasecmp(v, "close", 5) == 0)
+					keep_alive = 0;
+				else if (strncasecmp(v, "keep-alive", 10) == 0)
+					keep_alive = 1;
+			}
+			h = eol + 2;
+		}
+		if (body_len > SERVER_MAX_BODY) {
+			c->closing = 1;
+			server_respond(c, 413, "", 0);
+			return -1;
+		}
+		if (avail < head_len + body_len)
+			break;
+
+		c->closing = !keep_alive;
+		server_handle(s, c, p, (size_t)(sp1 - p), sp1 + 1, (size_t)(sp2 - sp1 - 1), p + head_len, body_len);
+		c->in_pos += head_len + body_len;
+	}
+
+	// 已处理的请求从缓冲区移除
+	if (c->in_pos == rs_len(&c->in)) {
+		rs_clear(&c->in);
+		c->in_pos = 0;
+	} else if (c->in_pos > SERVER_READ_SIZE) {
+		rapidstring rest;
+		rs_init_w_n(&rest, rs_data_c(&c->in) + c->in_pos, rs_len(&c->in) - c->in_pos);
+		rs_free(&c->in);
+		c->in = rest;
+		c->in_pos = 0;
+	}
+	return 0;
+}
+
+static inline int server_paused(const server_conn_t* c)
+{
+	return rs_len(&c->in) - c->in_pos >= SERVER_MAX_INPUT || rs_len(&c->out) - c->out_pos >= SERVER_OUT_HIGH;
+}
+
+// 读取可读的数据并处理, 直到没有数据或需要暂停. 对方关闭或出错时返回 -1
+static int server_read(server_t* s, server_conn_t* c)
+{
+	char buf[SERVER_READ_SIZE];
+	int rc = 0;
+	if (s->ops->enter)
+		s->ops->enter(s->ctx);
+	while (!c->closing && !server_paused(c)) {
+		long n = recv(c->fd, buf, sizeof(buf), 0);
+		if (n > 0) {
+			rs_cat_n(&c->in, buf, (size_t)n);
+			server_process(s, c);
+			continue;
+		}
+		if (n < 0 && SERVER_WOULDBLOCK())
+			break;
+		// 对方关闭前发送的请求仍然回复
+		rc = -1;
+		break;
+	}
+	if (s->ops->leave)
+		s->ops->leave(s->ctx);
+	return rc;
+}
+
+// 尽量发送 out. 返回 1 表示还有数据等待可写, 0 表示发送完毕, -1 表示出错
+static int server_flush(server_conn_t* c)
+{
+	while (c->out_pos < rs_len(&c->out)) {
+		long n = send(c->fd, rs_data_c(&c->out) + c->out_pos, rs_len(&c->out) - c->out_pos, 0);
+		if (n < 0 && SERVER_WOULDBLOCK())
+			return 1;
+		if (n <= 0)
+			return -1;
+		c->out_pos += (size_t)n;
+	}
+	rs_clear(&c->out);
+	c->out_pos = 0;
+	return 0;
+}
+
+static server_conn_t* server_conn_new(server_socket_t fd)
+{
+	server_conn_t* c = calloc(1, sizeof(server_conn_t));
+	c->fd = fd;
+	rs_init(&c->in);
+	rs_init(&c->out);
+	return c;
+}
+
+static void server_conn_free(server_conn_t* c)
+{
+	server_close_socket(c->fd);
+	rs_free(&c->in);
+	rs_free(&c->out);
+	free(c);
+}
+
+static int server_listen(server_t* s, uint16_t port)
+{
+	struct sockaddr_in addr;
+	int on = 1;
+
+	s->listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (SERVER_INVALID(s->listener))
+		return -1;
+	setsockopt(s->listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(s->listener, (struct sockaddr*)&addr, sizeof(addr)) ||
+	        listen(s->listener, SOMAXCONN) || server_nonblocking(s->listener)) {
+		server_close_socket(s->listener);
+		return -1;
+	}
+	return 0;
+}
+
+// 接受一个等待的连接, 没有时返回 NULL
+static server_conn_t* server_accept(server_t* s)
+{
+	server_socket_t fd = accept(s->listener, NULL, NULL);
+	if (SERVER_INVALID(fd))
+		return NULL;
+	server_nonblocking(fd);
+	server_nodelay(fd);
+	return server_conn_new(fd);
+}
+
+#if defined(__linux__)
+
+static int server_loop(server_t* s)
+{
+	struct epoll_event ev, events[SERVER_MAX_EVENTS];
+	int ep = epoll_create1(0);
+	if (ep < 0)
+		return -1;
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	epoll_ctl(ep, EPOLL_CTL_ADD, s->listener, &ev);
+
+	while (!s_server_stop) {
+		int n = epoll_wait(ep, events, SERVER_MAX_EVENTS, 500);
+		for (int i = 0; i < n; i++) {
+			server_conn_t* c = events[i].data.ptr;
+			if (c == NULL) {
+				while ((c = server_accept(s)) != NULL) {
+					ev.events = c->events = EPOLLIN | EPOLLRDHUP;
+					ev.data.ptr = c;
+					epoll_ctl(ep, EPOLL_CTL_ADD, c->fd, &ev);
+				}
+				continue;
+			}
+			int rc = 0;
+			if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+				rc = server_read(s, c);
+			int pending = server_flush(c);
+			if (pending < 0 || (pending == 0 && (rc < 0 || c->closing))) {
+				epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+				server_conn_free(c);
+				continue;
+			}
+			// 发送缓冲区满时等待可写, 暂停读取时只等待可写
+			uint32_t want = (server_paused(c) ? 0 : EPOLLIN | EPOLLRDHUP) | (pending ? EPOLLOUT : 0);
+			if (want != c->events) {
+				ev.events = c->events = want;
+				ev.data.ptr = c;
+				epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+			}
+		}
+	}
+	close(ep);
+	return 0;
+}
+
+#else
+
+// 没有 epoll 的平台使用 select, 连接数受 FD_SETSIZE 限制
+static int server_loop(server_t* s)
+{
+	server_conn_t* conns[FD_SETSIZE];
+	size_t n_conns = 0;
+
+	while (!s_server_stop) {
+		fd_set rd, wr;
+		FD_ZERO(&rd);
+		FD_ZERO(&wr);
+		FD_SET(s->listener, &rd);
+		server_socket_t max_fd = s->listener;
+		for (size_t i = 0; i < n_conns; i++) {
+			if (!server_paused(conns[i]))
+				FD_SET(conns[i]->fd, &rd);
+			if (conns[i]->out_pos < rs_len(&conns[i]->out))
+				FD_SET(conns[i]->fd, &wr);
+			if (conns[i]->fd > max_fd)
+				max_fd = conns[i]->fd;
+		}
+		struct timeval tv = { 0, 500000 };
+		if (select((int)max_fd + 1, &rd, &wr, NULL, &tv) <= 0)
+			continue;
+
+		for (size_t i = 0; i < n_conns;) {
+			server_conn_t* c = conns[i];
+			int rc = 0;
+			if (FD_ISSET(c->fd, &rd))
+				rc = server_read(s, c);
+			int pending = server_flush(c);
+			if (pending < 0 || (pending == 0 && (rc < 0 || c->closing))) {
+				server_conn_free(c);
+				conns[i] = conns[--n_conns];
+				continue;
+			}
+			i++;
+		}
+		if (FD_ISSET(s->listener, &rd)) {
+			server_conn_t* c;
+			while (n_conns < FD_SETSIZE - 1 && (c = server_accept(s)) != NULL)
+				conns[n_conns++] = c;
+		}
+	}
+	for (size_t i = 0; i < n_conns; i++)
+		server_conn_free(conns[i]);
+	return 0;
+}
+
+#endif
+
+// 在 127.0.0.1:port 上服务, 直到收到 SIGINT 或 SIGTERM
+static int server_run(uint16_t port, const server_ops_t* ops, void* ctx)
+{
+	server_t s;
+	s.ops = ops;
+	s.ctx = ctx;
+	if (server_listen(&s, port)) {
+		fprintf(stderr, "error: Listen on 127.0.0.1:%u failed\n", port);
+		return -1;
+	}
+	s_server_stop = 0;
+	signal(SIGINT, server_on_signal);
+	signal(SIGTERM, server_on_signal);
+#if !defined(_WIN32)
+	signal(SIGPIPE, SIG_IGN);
+#endif
+	int rc = server_loop(&s);
+	server_close_socket(s.listener);
+	return rc;
+}
+
+/* Load-test client */
+
+typedef struct loadtest {
+	uint16_t port;
+	// 每个连接发送的请求数和每次流水线发送的请求数
+	size_t requests;
+	size_t depth;
+	const char* const* keys;
+	const size_t* lens;
+	size_t n_keys;
+	// 每个请求的延迟, 微秒
+	uint32_t* latencies;
+	size_t n_latencies;
+	size_t errors;
+	uint64_t seed;
+} loadtest_t;
+
+static void loadtest_request(rapidstring* s, const char* key, size_t len)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	rs_cat_n(s, "GET /lookup?q=", 14);
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)key[i];
+		if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_') {
+			rs_cat_n(s, key + i, 1);
+		} else {
+			char e[3] = { '%', hex[c >> 4], hex[c & 15] };
+			rs_cat_n(s, e, 3);
+		}
+	}
+	static const char tail[] = " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+	rs_cat_n(s, tail, sizeof(tail) - 1);
+}
+
+static void* loadtest_run(void* arg)
+{
+	loadtest_t* t = arg;
+	struct sockaddr_in addr;
+	rapidstring req, in;
+	size_t in_pos = 0;
+
+	rs_init(&req);
+	rs_init(&in);
+	server_socket_t fd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(t->port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (SERVER_INVALID(fd) || connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+		t->errors = t->requests;
+		if (!SERVER_INVALID(fd))
+			server_close_socket(fd);
+		rs_free(&req);
+		rs_free(&in);
+		return NULL;
+	}
+	server_nodelay(fd);
+
+	while (t->n_latencies < t->requests) {
+		size_t depth = t->depth;
+		if (depth > t->requests - t->n_latencies)
+			depth = t->requests - t->n_latencies;
+		rs_clear(&req);
+		for (size_t i = 0; i < depth; i++) {
+			// xorshift, 每个线程独立的随机序列
+			t->seed ^= t->seed << 13;
+			t->seed ^= t->seed >> 7;
+			t->seed ^= t->seed << 17;
+			size_t k = (size_t)(t->seed % t->n_keys);
+			loadtest_request(&req, t->keys[k], t->lens[k]);
+		}
+		uint64_t t_send = server_now_us();
+		if (send(fd, rs_data_c(&req), rs_len(&req), 0) != (long)rs_len(&req))
+			goto error;
+
+		// 按顺序读取 depth 个响应
+		for (size_t done = 0; done < depth;) {
+			const char* p = rs_data_c(&in) + in_pos;
+			size_t avail = rs_len(&in) - in_pos;
+			const char* head_end = NULL;
+			for (size_t i = 3; i < avail; i++) {
+				if (p[i] == '\n' && p[i - 3] == '\r' && p[i - 2] == '\n') {
+					head_end = p + i + 1;
+					break;
+				}
+			}
+			if (head_end) {
+				const char* cl = NULL;
+				for (const char* h = p; h + 15 < head_end; h++) {
+					if (strncasecmp(h, "Content-Length:", 15) == 0) {
+						cl = h + 15;
+						break;
+					}
+				}
+				size_t body = cl ? (size_t)strtoull(cl, NULL, 10) : 0;
+				size_t total = (size_t)(head_end - p) + body;
+				if (avail >= total) {
+					if (memcmp(p, "HTTP/1.1 200", 12) != 0 && memcmp(p, "HTTP/1.1 404", 12) != 0)
+						t->errors++;
+					t->latencies[t->n_latencies++] = (uint32_t)(server_now_us() - t_send);
+					in_pos += total;
+					done++;
+					continue;
+				}
+			}
+			char buf[SERVER_READ_SIZE];
+			long n = recv(fd, buf, sizeof(buf), 0);
+			if (n <= 0)
+				goto error;
+			if (in_pos == rs_len(&in)) {
+				rs_clear(&in);
+				in_pos = 0;
+			}
+			rs_cat_n(&in, buf, (size_t)n);
+		}
+	}
+	goto done;
+
+error:
+	t->errors += t->requests - t->n_latencies;
+done:
+	server_close_socket(fd);
+	rs_free(&req);
+	rs_free(&in);
+	return NULL;
+}
+
+static int loadtest_compare(const void* a, const void* b)
+{
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+// connections 个连接并发请求随机的 key, 输出吞吐量和延迟分位数
+static int loadtest(uint16_t port, size_t connections, size_t requests, size_t depth,
+                    const char* const* keys, const size_t* lens, size_t n_keys)
+{
+	loadtest_t* tests = calloc(connections, sizeof(loadtest_t));
+	pthread_t* threads = calloc(connections, sizeof(pthread_t));
+	uint32_t* all = malloc(connections * requests * sizeof(uint32_t));
+	size_t n = 0, errors = 0;
+
+	if (!tests || !threads || !all || n_keys == 0) {
+		free(tests);
+		free(threads);
+		free(all);
+		return -1;
+	}
+	uint64_t t_start = server_now_us();
+	for (size_t i = 0; i < connections; i++) {
+		loadtest_t* t = &tests[i];
+		t->port = port;
+		t->requests = requests;
+		t->depth = depth ? depth : 1;
+		t->keys = keys;
+		t->lens = lens;
+		t->n_keys = n_keys;
+		t->latencies = all + i * requests;
+		t->seed = (uint64_t)(i + 1) * 0x9e3779b97f4a7c15ULL;
+		pthread_create(&threads[i], NULL, loadtest_run, t);
+	}
+	for (size_t i = 0; i < connections; i++) {
+		pthread_join(threads[i], NULL);
+		// 每个线程的结果移到数组前部
+		memmove(all + n, tests[i].latencies, tests[i].n_latencies * sizeof(uint32_t));
+		n += tests[i].n_latencies;
+		errors += tests[i].errors;
+	}
+	double seconds = (double)(server_now_us() - t_start) / 1e6;
+
+	qsort(all, n, sizeof(uint32_t), loadtest_compare);
+	printf("requests=%zu errors=%zu seconds=%.3f rps=%.0f", n, errors, seconds, n / seconds);
+	if (n > 0) {
+		printf(" p50_us=%u p90_us=%u p99_us=%u p999_us=%u max_us=%u",
+		       all[n / 2], all[n * 9 / 10], all[n * 99 / 100], all[n * 999 / 1000], all[n - 1]);
+	}
+	printf("\n");
+	free(tests);
+	free(threads);
+	free(all);
+	return errors ? -1 : 0;
+}
+
+#endif
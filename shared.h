@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include "logger.h"
 
 #define LOG_COLOURED 1
 #define DEBUG 0
@@ -26,20 +27,40 @@
 #    define debug(M, ...) fprintf(stderr, "DEBUG %s:%d: " M "\n", __FILE__, __LINE__, ##__VA_ARGS__)
 #endif
 
-#define log(format, loglevel, ...) printf("%s " format "\n", loglevel, ##__VA_ARGS__)
+// 日志由 logger.h 异步写出. 低于 LOG_LEVEL 的日志在编译时去掉,
+// 运行时的级别由 logger_start() 设置
+#ifndef LOG_LEVEL
+#    define LOG_LEVEL LOG_LEVEL_DBG
+#endif
+
+#define log(format, loglevel, ...) log_write(LOG_LEVEL_INFO, loglevel, format, ##__VA_ARGS__)
 
 #define clean_errno() (errno == 0 ? "None" : strerror(errno))
 
-#define log_err(format, ...) log(format, RED("ERR"), ##__VA_ARGS__)
-#define log_fatal(format, ...)                \
-    log(format, RED("FATAL"), ##__VA_ARGS__); \
+#define log_err(format, ...) log_write(LOG_LEVEL_ERR, RED("ERR"), format, ##__VA_ARGS__)
+#define log_fatal(format, ...)                                      \
+    log_write(LOG_LEVEL_FATAL, RED("FATAL"), format, ##__VA_ARGS__); \
     exit(1)
-#define log_warn(format, ...) log(format, YELLOW("WARN"), ##__VA_ARGS__)
-#define log_info(format, ...) log(format, GREEN("INFO"), ##__VA_ARGS__)
 
-#define log_dbg(format, ...) \
-    if (DEBUG)               \
-    log("[%s:%d] " format, GREEN("DBG"), __FILE__, __LINE__, ##__VA_ARGS__)
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#    define log_warn(format, ...) log_write(LOG_LEVEL_WARN, YELLOW("WARN"), format, ##__VA_ARGS__)
+#else
+#    define log_warn(format, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#    define log_info(format, ...) log_write(LOG_LEVEL_INFO, GREEN("INFO"), format, ##__VA_ARGS__)
+#else
+#    define log_info(format, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_DBG
+#    define log_dbg(format, ...) \
+        if (DEBUG)               \
+        log_write(LOG_LEVEL_DBG, GREEN("DBG"), "[%s:%d] " format, __FILE__, __LINE__, ##__VA_ARGS__)
+#else
+#    define log_dbg(format, ...) ((void)0)
+#endif
 
 void log_pid(const char* msg);
 
@@ -0,0 +1,474 @@
+#ifndef STARDICT_H__
+#define STARDICT_H__
+
+/*
+ * StarDict dictionary exported from the dic table in one pass.
+ *
+ *   youdao.ifo       key=value metadata, written last
+ *   youdao.idx       sorted entries: word\0, u32 offset, u32 size (big-endian)
+ *   youdao.dict      definitions back to back (sametypesequence=m)
+ *   youdao.syn       optional, sorted: form\0, u32 entry index (big-endian)
+ *   youdao.dict.dz   optional dictzip form of youdao.dict
+ *
+ * The cursor returns rows in StarDict order (ASCII case-insensitive, then
+ * byte order), so .idx and .dict are appended as rows arrive; readers can
+ * mmap .idx and binary search it directly. Only the synonyms are kept in
+ * memory, to be sorted at the end.
+ *
+ * dictzip is a gzip file whose deflate stream is cut into chunks of
+ * STARDICT_CHUNK bytes with a full flush after each; the RA extra field
+ * lists the compressed size of every chunk, so a reader seeks to one chunk
+ * and inflates only that. There is no zlib in the tree, the chunks are
+ * compressed here with LZ77 and the fixed deflate Huffman codes.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sqlite3.h>
+#include "rapidstring.h"
+#include "export.h"
+
+#define STARDICT_MAX_PATH 1024
+// 规范要求单词短于 256 字节
+#define STARDICT_MAX_WORD 256
+// 不超过 32 KB, 保证固定哈夫曼编码后的块大小能用 u16 表示
+#define STARDICT_CHUNK 32768
+#define STARDICT_MAX_CHUNKS ((65535 - 10) / 2)
+#define STARDICT_HASH_BITS 15
+#define STARDICT_MAX_CHAIN 64
+
+#define SQL_STARDICT_ROWS SQL_EXPORT_ROWS("key COLLATE NOCASE, key")
+
+typedef struct stardict_syn {
+	const char* word;
+	uint32_t index;
+} stardict_syn_t;
+
+// StarDict 的排序: 先忽略 ASCII 大小写比较, 相同时再按字节比较
+static int stardict_strcmp(const char* a, const char* b)
+{
+	const unsigned char* p = (const unsigned char*)a;
+	const unsigned char* q = (const unsigned char*)b;
+	for (;; p++, q++) {
+		int c = (*p >= 'A' && *p <= 'Z') ? *p + 32 : *p;
+		int d = (*q >= 'A' && *q <= 'Z') ? *q + 32 : *q;
+		if (c != d)
+			return c - d;
+		if (c == 0)
+			break;
+	}
+	return strcmp(a, b);
+}
+
+static int stardict_syn_cmp(const void* a, const void* b)
+{
+	const stardict_syn_t* x = a;
+	const stardict_syn_t* y = b;
+	int rc = stardict_strcmp(x->word, y->word);
+	if (rc == 0)
+		rc = (x->index > y->index) - (x->index < y->index);
+	return rc;
+}
+
+static inline void stardict_be32(unsigned char* p, uint32_t v)
+{
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
+}
+
+// 词形中的英文单词作为同义词, 记录 "form\0" 到 arena, 位置和词条序号到 syns
+static void stardict_add_forms(rapidstring* arena, rapidstring* syns, const char* key, const char* forms, uint32_t index)
+{
+	size_t key_len = strlen(key);
+	const char* p = forms;
+	const char* start;
+	size_t len;
+
+	while ((start = export_next_form(&p, &len)) != NULL) {
+		if (len >= STARDICT_MAX_WORD || (len == key_len && memcmp(start, key, len) == 0))
+			continue;
+		uint32_t rec[2] = { (uint32_t)rs_len(arena), index };
+		rs_cat_n(arena, start, len);
+		rs_cat_n(arena, "", 1);
+		rs_cat_n(syns, (const char*)rec, sizeof(rec));
+	}
+}
+
+static long stardict_write_syn(const char* path, rapidstring* arena, rapidstring* syns)
+{
+	size_t n = rs_len(syns) / (2 * sizeof(uint32_t));
+	const uint32_t* rec = (const uint32_t*)rs_data_c(syns);
+	stardict_syn_t* list = malloc((n ? n : 1) * sizeof(stardict_syn_t));
+	long count = 0;
+
+	if (list == NULL)
+		return -1;
+	for (size_t i = 0; i < n; i++) {
+		list[i].word = rs_data_c(arena) + rec[i * 2];
+		list[i].index = rec[i * 2 + 1];
+	}
+	qsort(list, n, sizeof(stardict_syn_t), stardict_syn_cmp);
+
+	FILE* f = fopen(path, "wb");
+	if (f == NULL) {
+		fprintf(stderr, "error: Can't open %s: %s\n", path, strerror(errno));
+		free(list);
+		return -1;
+	}
+	for (size_t i = 0; i < n; i++) {
+		// 同一个词条的重复词形只写一次
+		if (i > 0 && list[i].index == list[i - 1].index && strcmp(list[i].word, list[i - 1].word) == 0)
+			continue;
+		unsigned char be[4];
+		stardict_be32(be, list[i].index);
+		fwrite(list[i].word, 1, strlen(list[i].word) + 1, f);
+		fwrite(be, 1, 4, f);
+		count++;
+	}
+	free(list);
+	return fclose(f) ? -1 : count;
+}
+
+static uint32_t stardict_crc32(uint32_t crc, const unsigned char* p, size_t len)
+{
+	static uint32_t table[256];
+	if (table[1] == 0) {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+	}
+	crc = ~crc;
+	for (size_t i = 0; i < len; i++)
+		crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+typedef struct stardict_bits {
+	rapidstring* out;
+	uint32_t bits;
+	int count;
+} stardict_bits_t;
+
+static inline void stardict_put_bits(stardict_bits_t* b, uint32_t value, int n)
+{
+	b->bits |= value << b->count;
+	b->count += n;
+	while (b->count >= 8) {
+		char c = (char)(b->bits & 0xff);
+		rs_cat_n(b->out, &c, 1);
+		b->bits >>= 8;
+		b->count -= 8;
+	}
+}
+
+// 哈夫曼码从最高位开始写
+static inline void stardict_put_code(stardict_bits_t* b, uint32_t code, int n)
+{
+	uint32_t r = 0;
+	for (int i = 0; i < n; i++)
+		r |= ((code >> i) & 1) << (n - 1 - i);
+	stardict_put_bits(b, r, n);
+}
+
+static inline void stardict_put_align(stardict_bits_t* b)
+{
+	if (b->count > 0)
+		stardict_put_bits(b, 0, 8 - b->count);
+}
+
+// 固定哈夫曼编码的字面量/长度符号
+static void stardict_put_symbol(stardict_bits_t* b, int sym)
+{
+	if (sym < 144)
+		stardict_put_code(b, 0x30 + sym, 8);
+	else if (sym < 256)
+		stardict_put_code(b, 0x190 + sym - 144, 9);
+	else if (sym < 280)
+		stardict_put_code(b, sym - 256, 7);
+	else
+		stardict_put_code(b, 0xc0 + sym - 280, 8);
+}
+
+static void stardict_put_match(stardict_bits_t* b, int len, int dist)
+{
+	static const uint16_t len_base[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	                                     35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static const uint8_t len_extra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	                                     3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static const uint16_t dist_base[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+	                                      193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+	                                      6145, 8193, 12289, 16385, 24577 };
+	int i = 28;
+	while (len_base[i] > len)
+		i--;
+	stardict_put_symbol(b, 257 + i);
+	stardict_put_bits(b, len - len_base[i], len_extra[i]);
+	i = 29;
+	while (dist_base[i] > dist)
+		i--;
+	stardict_put_code(b, i, 5);
+	stardict_put_bits(b, dist - dist_base[i], i < 4 ? 0 : i / 2 - 1);
+}
+
+// 压缩一块, 以全刷新 (空的存储块) 结束, 不引用之前的块. 最后一块再追加结束块
+static void stardict_deflate_chunk(const unsigned char* in, size_t len, int last, rapidstring* out,
+                                   int32_t* head, int32_t* prev)
+{
+	stardict_bits_t b = { out, 0, 0 };
+
+	for (size_t i = 0; i < (1u << STARDICT_HASH_BITS); i++)
+		head[i] = -1;
+	stardict_put_bits(&b, 0, 1);
+	stardict_put_bits(&b, 1, 2);
+
+	size_t i = 0;
+	while (i < len) {
+		int best = 0, dist = 0;
+		if (i + 3 <= len) {
+			uint32_t h = ((in[i] << 10) ^ (in[i + 1] << 5) ^ in[i + 2]) & ((1u << STARDICT_HASH_BITS) - 1);
+			size_t max = len - i < 258 ? len - i : 258;
+			int chain = STARDICT_MAX_CHAIN;
+			for (int32_t j = head[h]; j >= 0 && chain-- > 0; j = prev[j]) {
+				size_t k = 0;
+				while (k < max && in[j + k] == in[i + k])
+					k++;
+				if ((int)k > best) {
+					best = (int)k;
+					dist = (int)(i - j);
+					if (k == max)
+						break;
+				}
+			}
+			prev[i] = head[h];
+			head[h] = (int32_t)i;
+		}
+		if (best >= 3) {
+			stardict_put_match(&b, best, dist);
+			// 匹配内部的位置也加入哈希链
+			for (size_t k = i + 1; k < i + best && k + 3 <= len; k++) {
+				uint32_t h = ((in[k] << 10) ^ (in[k + 1] << 5) ^ in[k + 2]) & ((1u << STARDICT_HASH_BITS) - 1);
+				prev[k] = head[h];
+				head[h] = (int32_t)k;
+			}
+			i += best;
+		} else {
+			stardict_put_symbol(&b, in[i]);
+			i++;
+		}
+	}
+	stardict_put_symbol(&b, 256);
+
+	stardict_put_bits(&b, 0, 3);
+	stardict_put_align(&b);
+	rs_cat_n(out, "\x00\x00\xff\xff", 4);
+	if (last) {
+		stardict_put_bits(&b, 1, 1);
+		stardict_put_bits(&b, 1, 2);
+		stardict_put_symbol(&b, 256);
+		stardict_put_align(&b);
+	}
+}
+
+// 把 src 转换为 dictzip 文件 dst
+static int stardict_dictzip(const char* src, const char* dst)
+{
+	FILE* in = fopen(src, "rb");
+	if (in == NULL) {
+		fprintf(stderr, "error: Can't open %s: %s\n", src, strerror(errno));
+		return -1;
+	}
+	fseek(in, 0, SEEK_END);
+	long size = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	size_t chunks = size > 0 ? ((size_t)size + STARDICT_CHUNK - 1) / STARDICT_CHUNK : 1;
+	if (size < 0 || chunks > STARDICT_MAX_CHUNKS) {
+		fprintf(stderr, "error: %s is too large for dictzip\n", src);
+		fclose(in);
+		return -1;
+	}
+	FILE* out = fopen(dst, "wb");
+	if (out == NULL) {
+		fprintf(stderr, "error: Can't open %s: %s\n", dst, strerror(errno));
+		fclose(in);
+		return -1;
+	}
+
+	// gzip 头和 RA 扩展字段, 块大小在压缩完后回填
+	size_t xlen = 10 + chunks * 2;
+	unsigned char* header = calloc(1, 12 + xlen);
+	uint32_t mtime = (uint32_t)time(NULL);
+	header[0] = 0x1f;
+	header[1] = 0x8b;
+	header[2] = 8;
+	header[3] = 4;
+	header[4] = (unsigned char)mtime;
+	header[5] = (unsigned char)(mtime >> 8);
+	header[6] = (unsigned char)(mtime >> 16);
+	header[7] = (unsigned char)(mtime >> 24);
+	header[8] = 2;
+	header[9] = 3;
+	header[10] = (unsigned char)xlen;
+	header[11] = (unsigned char)(xlen >> 8);
+	header[12] = 'R';
+	header[13] = 'A';
+	header[14] = (unsigned char)(xlen - 4);
+	header[15] = (unsigned char)((xlen - 4) >> 8);
+	header[16] = 1;
+	header[18] = (unsigned char)STARDICT_CHUNK;
+	header[19] = (unsigned char)(STARDICT_CHUNK >> 8);
+	header[20] = (unsigned char)chunks;
+	header[21] = (unsigned char)(chunks >> 8);
+	fwrite(header, 1, 12 + xlen, out);
+
+	unsigned char* buf = malloc(STARDICT_CHUNK);
+	int32_t* head = malloc(sizeof(int32_t) << STARDICT_HASH_BITS);
+	int32_t* prev = malloc(sizeof(int32_t) * STARDICT_CHUNK);
+	rapidstring z;
+	uint32_t crc = 0;
+	int rc = 0;
+
+	rs_init(&z);
+	for (size_t c = 0; c < chunks; c++) {
+		size_t n = fread(buf, 1, STARDICT_CHUNK, in);
+		crc = stardict_crc32(crc, buf, n);
+		rs_clear(&z);
+		stardict_deflate_chunk(buf, n, c + 1 == chunks, &z, head, prev);
+		header[22 + c * 2] = (unsigned char)rs_len(&z);
+		header[23 + c * 2] = (unsigned char)(rs_len(&z) >> 8);
+		if (fwrite(rs_data_c(&z), 1, rs_len(&z), out) != rs_len(&z))
+			rc = -1;
+	}
+	unsigned char trailer[8] = {
+		(unsigned char)crc, (unsigned char)(crc >> 8), (unsigned char)(crc >> 16), (unsigned char)(crc >> 24),
+		(unsigned char)size, (unsigned char)(size >> 8), (unsigned char)(size >> 16), (unsigned char)(size >> 24)
+	};
+	fwrite(trailer, 1, 8, out);
+	fseek(out, 0, SEEK_SET);
+	fwrite(header, 1, 12 + xlen, out);
+
+	if (fclose(out))
+		rc = -1;
+	fclose(in);
+	rs_free(&z);
+	free(header);
+	free(buf);
+	free(head);
+	free(prev);
+	return rc;
+}
+
+// 导出到目录 dir, syn 为 1 时写入 .syn, dictzip 为 1 时压缩 .dict. 返回词条数, 失败返回 -1
+static long stardict_export(sqlite3* db, const char* dir, int syn, int dictzip)
+{
+	char path[STARDICT_MAX_PATH], dict_path[STARDICT_MAX_PATH];
+	sqlite3_stmt* s;
+	FILE *idx = NULL, *dict = NULL;
+	rapidstring arena, syns;
+	uint32_t count = 0, skipped = 0;
+	uint64_t offset = 0, idx_size = 0;
+	long syn_count = 0;
+	long rc = -1;
+
+	if (export_mkdir(dir) && errno != EEXIST) {
+		fprintf(stderr, "error: Can't create %s: %s\n", dir, strerror(errno));
+		return -1;
+	}
+	if (sqlite3_prepare_v2(db, SQL_STARDICT_ROWS, -1, &s, NULL)) {
+		fprintf(stderr, "error: Prepare stmt %s failed, %s\n", SQL_STARDICT_ROWS, sqlite3_errmsg(db));
+		return -1;
+	}
+	rs_init(&arena);
+	rs_init(&syns);
+	snprintf(path, sizeof(path), "%s/youdao.idx", dir);
+	snprintf(dict_path, sizeof(dict_path), "%s/youdao.dict", dir);
+	if ((idx = fopen(path, "wb")) == NULL || (dict = fopen(dict_path, "wb")) == NULL) {
+		fprintf(stderr, "error: Can't open %s: %s\n", idx ? dict_path : path, strerror(errno));
+		goto done;
+	}
+
+	int step;
+	while ((step = sqlite3_step(s)) == SQLITE_ROW) {
+		const char* key = (const char*)sqlite3_column_text(s, 0);
+		size_t key_len = sqlite3_column_bytes(s, 0);
+		const char* word = (const char*)sqlite3_column_text(s, 1);
+		size_t word_len = sqlite3_column_bytes(s, 1);
+		const char* forms = (const char*)sqlite3_column_text(s, 2);
+
+		if (key_len == 0 || key_len >= STARDICT_MAX_WORD || offset + word_len > UINT32_MAX) {
+			skipped++;
+			continue;
+		}
+		unsigned char be[8];
+		stardict_be32(be, (uint32_t)offset);
+		stardict_be32(be + 4, (uint32_t)word_len);
+		if (fwrite(key, 1, key_len + 1, idx) != key_len + 1 || fwrite(be, 1, 8, idx) != 8 ||
+		        fwrite(word, 1, word_len, dict) != word_len) {
+			fprintf(stderr, "error: Write %s failed: %s\n", dir, strerror(errno));
+			goto done;
+		}
+		offset += word_len;
+		idx_size += key_len + 1 + 8;
+		if (syn && forms)
+			stardict_add_forms(&arena, &syns, key, forms, count);
+		count++;
+	}
+	// SQLITE_BUSY 等错误也会结束循环, 不能把不完整的词典当作成功
+	if (step != SQLITE_DONE) {
+		fprintf(stderr, "error: Read dic failed (%d), %s\n", step, sqlite3_errmsg(db));
+		goto done;
+	}
+	if (fclose(idx) | fclose(dict)) {
+		idx = dict = NULL;
+		fprintf(stderr, "error: Write %s failed: %s\n", dir, strerror(errno));
+		goto done;
+	}
+	idx = dict = NULL;
+	if (skipped)
+		fprintf(stderr, "warning: Skipped %u words longer than %d bytes\n", skipped, STARDICT_MAX_WORD - 1);
+
+	if (syn) {
+		snprintf(path, sizeof(path), "%s/youdao.syn", dir);
+		if ((syn_count = stardict_write_syn(path, &arena, &syns)) < 0)
+			goto done;
+	}
+	if (dictzip) {
+		snprintf(path, sizeof(path), "%s/youdao.dict.dz", dir);
+		if (stardict_dictzip(dict_path, path))
+			goto done;
+		remove(dict_path);
+	}
+
+	snprintf(path, sizeof(path), "%s/youdao.ifo", dir);
+	FILE* ifo = fopen(path, "wb");
+	if (ifo == NULL) {
+		fprintf(stderr, "error: Can't open %s: %s\n", path, strerror(errno));
+		goto done;
+	}
+	fprintf(ifo, "StarDict's dict ifo file\nversion=2.4.2\nbookname=Youdao\nwordcount=%u\n", count);
+	if (syn)
+		fprintf(ifo, "synwordcount=%ld\n", syn_count);
+	fprintf(ifo, "idxfilesize=%llu\nsametypesequence=m\n", (unsigned long long)idx_size);
+	if (fclose(ifo) == 0)
+		rc = count;
+
+done:
+	if (idx)
+		fclose(idx);
+	if (dict)
+		fclose(dict);
+	sqlite3_finalize(s);
+	rs_free(&arena);
+	rs_free(&syns);
+	return rc;
+}
+
+#endif
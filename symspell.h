@@ -0,0 +1,326 @@
+#ifndef SYMSPELL_H__
+#define SYMSPELL_H__
+
+/*
+ * Spelling correction over a fixed word list (symmetric delete, SymSpell
+ * style).
+ *
+ * Every word is indexed under all strings obtained by deleting up to
+ * SYMSPELL_MAX_DISTANCE characters from its first SYMSPELL_PREFIX_LENGTH
+ * characters. A misspelled word generates the same deletes, so candidates
+ * within the edit distance are found by hash probes only, without touching
+ * the rest of the dictionary. The table keeps a 32 bit hash of each delete
+ * and the indexes of the words sharing it, not the deletes themselves; hash
+ * collisions are harmless because every candidate is verified with the real
+ * edit distance.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rapidstring.h"
+
+#define SYMSPELL_MAX_DISTANCE 2
+// 只对前缀生成删除串, 限制长单词的删除串数量
+#define SYMSPELL_PREFIX_LENGTH 7
+// 前缀最多产生 1 + 7 + 21 个删除串
+#define SYMSPELL_MAX_DELETES 29
+#define SYMSPELL_MAX_WORD 64
+
+typedef struct symspell_slot {
+	uint32_t hash;
+	// postings[start, start + count) 为拥有该删除串的单词序号, count 为 0 表示空槽
+	uint32_t start;
+	uint32_t count;
+} symspell_slot_t;
+
+typedef struct symspell {
+	// 构建期间收集的 (哈希 << 32 | 单词序号), symspell_build 后释放
+	uint64_t* pairs;
+	size_t n_pairs;
+	size_t cap_pairs;
+	symspell_slot_t* slots;
+	size_t mask;
+	uint32_t* postings;
+	// 单词依次存放在 words 中, offsets[i] 为第 i 个单词的开始位置
+	rapidstring words;
+	uint32_t* offsets;
+	uint32_t count;
+	uint32_t capacity;
+} symspell_t;
+
+typedef struct symspell_suggestion {
+	uint32_t word;
+	int distance;
+} symspell_suggestion_t;
+
+static inline uint32_t symspell_hash(const char* s, size_t len)
+{
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < len; i++)
+		h = (h ^ (uint8_t)s[i]) * 16777619u;
+	return h;
+}
+
+static inline void symspell_init(symspell_t* s)
+{
+	memset(s, 0, sizeof(*s));
+	rs_init(&s->words);
+}
+
+static inline void symspell_free(symspell_t* s)
+{
+	free(s->pairs);
+	free(s->slots);
+	free(s->postings);
+	free(s->offsets);
+	rs_free(&s->words);
+	memset(s, 0, sizeof(*s));
+}
+
+static inline const char* symspell_word(const symspell_t* s, uint32_t i, size_t* len)
+{
+	*len = s->offsets[i + 1] - s->offsets[i];
+	return rs_data_c(&s->words) + s->offsets[i];
+}
+
+// 把 word 删除 1..remain 个字符得到的串的哈希追加到 hashes
+static void symspell_deletes_from(const char* word, size_t len, int remain, uint32_t* hashes, size_t* n)
+{
+	char buf[SYMSPELL_PREFIX_LENGTH];
+	if (remain == 0 || len == 0)
+		return;
+	for (size_t i = 0; i < len; i++) {
+		memcpy(buf, word, i);
+		memcpy(buf + i, word + i + 1, len - i - 1);
+		hashes[(*n)++] = symspell_hash(buf, len - 1);
+		symspell_deletes_from(buf, len - 1, remain - 1, hashes, n);
+	}
+}
+
+static int symspell_compare_u32(const void* a, const void* b)
+{
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static int symspell_compare_u64(const void* a, const void* b)
+{
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+// 生成前缀本身和它的删除串的哈希, 去重后返回数量
+static size_t symspell_deletes(const char* word, size_t len, uint32_t* hashes)
+{
+	// 递归会重复生成同一个删除串, 缓冲区按最坏情况 1 + 7 + 7 * 6 分配
+	uint32_t all[1 + SYMSPELL_PREFIX_LENGTH + SYMSPELL_PREFIX_LENGTH * (SYMSPELL_PREFIX_LENGTH - 1)];
+	size_t n = 0, unique = 0;
+
+	if (len > SYMSPELL_PREFIX_LENGTH)
+		len = SYMSPELL_PREFIX_LENGTH;
+	all[n++] = symspell_hash(word, len);
+	symspell_deletes_from(word, len, SYMSPELL_MAX_DISTANCE, all, &n);
+	qsort(all, n, sizeof(uint32_t), symspell_compare_u32);
+	for (size_t i = 0; i < n; i++) {
+		if (i == 0 || all[i] != all[i - 1])
+			hashes[unique++] = all[i];
+	}
+	return unique;
+}
+
+// 加入一个单词. 调用者保证单词不重复, 全部加入后调用 symspell_build
+static int symspell_add(symspell_t* s, const char* word, size_t len)
+{
+	uint32_t hashes[SYMSPELL_MAX_DELETES];
+
+	if (len == 0 || len > SYMSPELL_MAX_WORD)
+		return 0;
+	if (s->count + 2 > s->capacity) {
+		uint32_t capacity = s->capacity ? s->capacity * 2 : 1024;
+		uint32_t* offsets = realloc(s->offsets, (size_t)capacity * sizeof(uint32_t));
+		if (offsets == NULL)
+			return -1;
+		if (s->offsets == NULL)
+			offsets[0] = 0;
+		s->offsets = offsets;
+		s->capacity = capacity;
+	}
+
+	size_t n = symspell_deletes(word, len, hashes);
+	if (s->n_pairs + n > s->cap_pairs) {
+		size_t capacity = s->cap_pairs ? s->cap_pairs * 2 : 4096;
+		uint64_t* pairs = realloc(s->pairs, capacity * sizeof(uint64_t));
+		if (pairs == NULL)
+			return -1;
+		s->pairs = pairs;
+		s->cap_pairs = capacity;
+	}
+	for (size_t i = 0; i < n; i++)
+		s->pairs[s->n_pairs++] = (uint64_t)hashes[i] << 32 | s->count;
+
+	rs_cat_n(&s->words, word, len);
+	s->offsets[++s->count] = (uint32_t)rs_len(&s->words);
+	return 0;
+}
+
+// 按哈希排序删除串, 相同哈希的单词序号连续存放, 哈希表只保存每个哈希一次
+static int symspell_build(symspell_t* s)
+{
+	size_t unique = 0, capacity = 1024;
+
+	qsort(s->pairs, s->n_pairs, sizeof(uint64_t), symspell_compare_u64);
+	for (size_t i = 0; i < s->n_pairs; i++) {
+		if (i == 0 || s->pairs[i] >> 32 != s->pairs[i - 1] >> 32)
+			unique++;
+	}
+	// 装载率保持在 1/2 以下
+	while (capacity < unique * 2)
+		capacity *= 2;
+	free(s->slots);
+	free(s->postings);
+	s->slots = calloc(capacity, sizeof(symspell_slot_t));
+	s->postings = malloc((s->n_pairs ? s->n_pairs : 1) * sizeof(uint32_t));
+	if (s->slots == NULL || s->postings == NULL)
+		return -1;
+	s->mask = capacity - 1;
+
+	for (size_t i = 0; i < s->n_pairs;) {
+		uint32_t hash = (uint32_t)(s->pairs[i] >> 32);
+		size_t j = i;
+		for (; j < s->n_pairs && (uint32_t)(s->pairs[j] >> 32) == hash; j++)
+			s->postings[j] = (uint32_t)s->pairs[j];
+		size_t p = hash & s->mask;
+		while (s->slots[p].count)
+			p = (p + 1) & s->mask;
+		s->slots[p].hash = hash;
+		s->slots[p].start = (uint32_t)i;
+		s->slots[p].count = (uint32_t)(j - i);
+		i = j;
+	}
+	free(s->pairs);
+	s->pairs = NULL;
+	s->n_pairs = s->cap_pairs = 0;
+	return 0;
+}
+
+// 受限的 Damerau-Levenshtein 距离 (相邻交换算一次编辑), 超过 max 时返回 max + 1.
+// 距离不超过 max 的路径不会离开对角线 max 格以外, 每行只计算这一条带
+static int symspell_distance(const char* a, size_t a_len, const char* b, size_t b_len, int max)
+{
+	int rows[3][SYMSPELL_MAX_WORD + 1];
+	int *prev2 = rows[0], *prev = rows[1], *cur = rows[2];
+	size_t band = (size_t)max;
+
+	if ((a_len > b_len ? a_len - b_len : b_len - a_len) > band)
+		return max + 1;
+	if (a_len > SYMSPELL_MAX_WORD || b_len > SYMSPELL_MAX_WORD)
+		return max + 1;
+	for (size_t j = 0; j <= b_len; j++)
+		prev[j] = j <= band ? (int)j : max + 1;
+	for (size_t i = 1; i <= a_len; i++) {
+		size_t lo = i > band ? i - band : 1;
+		size_t hi = i + band < b_len ? i + band : b_len;
+		int best = max + 1;
+		cur[0] = i <= band ? (int)i : max + 1;
+		if (lo > 1)
+			cur[lo - 1] = max + 1;
+		for (size_t j = lo; j <= hi; j++) {
+			int cost = a[i - 1] != b[j - 1];
+			int d = prev[j - 1] + cost;
+			if (prev[j] + 1 < d)
+				d = prev[j] + 1;
+			if (cur[j - 1] + 1 < d)
+				d = cur[j - 1] + 1;
+			if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1] && prev2[j - 2] + 1 < d)
+				d = prev2[j - 2] + 1;
+			cur[j] = d > max ? max + 1 : d;
+			if (d < best)
+				best = d;
+		}
+		if (hi < b_len)
+			cur[hi + 1] = max + 1;
+		// 整条带都超过 max 时不可能再变小
+		if (best > max)
+			return max + 1;
+		int* t = prev2;
+		prev2 = prev;
+		prev = cur;
+		cur = t;
+	}
+	return prev[b_len];
+}
+
+static int symspell_compare_suggestion(const void* a, const void* b)
+{
+	const symspell_suggestion_t* x = a;
+	const symspell_suggestion_t* y = b;
+	if (x->distance != y->distance)
+		return x->distance - y->distance;
+	return x->word < y->word ? -1 : x->word > y->word;
+}
+
+// 查找与 word 编辑距离不超过 max_distance 的单词, 按距离和单词序号排序,
+// 最多写入 limit 个, 返回写入的数量
+static size_t symspell_lookup(const symspell_t* s, const char* word, size_t len, int max_distance,
+                              symspell_suggestion_t* out, size_t limit)
+{
+	uint32_t hashes[SYMSPELL_MAX_DELETES];
+	symspell_suggestion_t found[64];
+	size_t n_found = 0;
+
+	if (s->slots == NULL || len == 0 || len > SYMSPELL_MAX_WORD || limit == 0)
+		return 0;
+	if (max_distance > SYMSPELL_MAX_DISTANCE)
+		max_distance = SYMSPELL_MAX_DISTANCE;
+
+	size_t n = symspell_deletes(word, len, hashes);
+	for (size_t i = 0; i < n; i++) {
+		size_t p = hashes[i] & s->mask;
+		while (s->slots[p].count && s->slots[p].hash != hashes[i])
+			p = (p + 1) & s->mask;
+		const symspell_slot_t* slot = &s->slots[p];
+		for (uint32_t e = slot->start; e < slot->start + slot->count; e++) {
+			uint32_t index = s->postings[e];
+			size_t c_len;
+			const char* c = symspell_word(s, index, &c_len);
+			// 长度差已经超过距离的单词不用计算
+			if ((c_len > len ? c_len - len : len - c_len) > (size_t)max_distance)
+				continue;
+			size_t k;
+			for (k = 0; k < n_found; k++) {
+				if (found[k].word == index)
+					break;
+			}
+			if (k < n_found)
+				continue;
+
+			int d = symspell_distance(word, len, c, c_len, max_distance);
+			if (d > max_distance)
+				continue;
+			if (n_found < sizeof(found) / sizeof(found[0])) {
+				k = n_found++;
+			} else {
+				// 候选太多时替换距离最大的一个
+				size_t worst = 0;
+				for (k = 1; k < n_found; k++) {
+					if (found[k].distance > found[worst].distance)
+						worst = k;
+				}
+				if (found[worst].distance <= d)
+					continue;
+				k = worst;
+			}
+			found[k].word = index;
+			found[k].distance = d;
+		}
+	}
+
+	qsort(found, n_found, sizeof(found[0]), symspell_compare_suggestion);
+	if (n_found > limit)
+		n_found = limit;
+	memcpy(out, found, n_found * sizeof(found[0]));
+	return n_found;
+}
+
+#endif
@@ -6,17 +6,12 @@
 // #include "tsdb.h"
 
 /* forward declaration */
-static void Transform(uint32_t *buf, uint32_t *in);
+static void Transform(uint32_t *buf, const uint8_t *block, size_t blocks);
 
-static uint8_t PADDING[64] = {0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                              0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                              0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                              0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                              0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-
-/* F, G, H and I are basic MD5 functions */
-#define F(x, y, z) (((x) & (y)) | ((~x) & (z)))
-#define G(x, y, z) (((x) & (z)) | ((y) & (~z)))
+/* F, G, H and I are basic MD5 functions. F and G select bits with one
+   operation less than the textbook (x & y) | (~x & z) form */
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
 #define H(x, y, z) ((x) ^ (y) ^ (z))
 #define I(x, y, z) ((y) ^ ((x) | (~z)))
 
@@ -50,12 +45,41 @@ static uint8_t PADDING[64] = {0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x
     (a) += (b);                                     \
   }
 
+/* Little-endian hosts load message words straight from the input,
+   others assemble them byte by byte */
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_M_IX86) || \
+    defined(_M_X64) || defined(_M_ARM64)
+#define MD5_LITTLE_ENDIAN 1
+#endif
+
+static void Decode(uint32_t *out, const uint8_t *in, size_t words) {
+#if defined(MD5_LITTLE_ENDIAN)
+  memcpy(out, in, words * 4);
+#else
+  size_t i;
+  for (i = 0; i < words; i++, in += 4)
+    out[i] = ((uint32_t)in[3] << 24) | ((uint32_t)in[2] << 16) | ((uint32_t)in[1] << 8) | (uint32_t)in[0];
+#endif
+}
+
+static void Encode(uint8_t *out, const uint32_t *in, size_t words) {
+#if defined(MD5_LITTLE_ENDIAN)
+  memcpy(out, in, words * 4);
+#else
+  size_t i;
+  for (i = 0; i < words; i++, out += 4) {
+    out[0] = (uint8_t)(in[i] & 0xFF);
+    out[1] = (uint8_t)((in[i] >> 8) & 0xFF);
+    out[2] = (uint8_t)((in[i] >> 16) & 0xFF);
+    out[3] = (uint8_t)((in[i] >> 24) & 0xFF);
+  }
+#endif
+}
+
 /* The routine MD5Init initializes the message-digest context
-   mdContext. All fields are set to zero.
+   mdContext. Only the bit count and the state need a value.
  */
 void MD5Init(MD5_CTX *mdContext) {
-  memset(mdContext, 0, sizeof(MD5_CTX));
-
   mdContext->i[0] = mdContext->i[1] = (uint32_t)0;
 
   /* Load magic initialization constants.
@@ -68,75 +92,132 @@ void MD5Init(MD5_CTX *mdContext) {
 
 /* The routine MD5Update updates the message-digest context to
 account for the presence of each of the characters inBuf[0..inLen-1]
-in the message whose digest is being computed.
+in the message whose digest is being computed. Whole blocks are
+transformed in place, only a partial block is copied to mdContext->in.
 */
-void MD5Update(MD5_CTX *mdContext, uint8_t *inBuf, unsigned int inLen) {
-  uint32_t     in[16];
-  int          mdi;
-  unsigned int i, ii;
+void MD5Update(MD5_CTX *mdContext, const void *inBuf, size_t inLen) {
+  const uint8_t *p = (const uint8_t *)inBuf;
+  size_t         mdi, fill;
+  uint64_t       bits;
 
   /* compute number of bytes mod 64 */
-  mdi = (int)((mdContext->i[0] >> 3) & 0x3F);
+  mdi = (size_t)((mdContext->i[0] >> 3) & 0x3F);
 
   /* update number of bits */
-  if ((mdContext->i[0] + ((uint32_t)inLen << 3)) < mdContext->i[0]) mdContext->i[1]++;
-  mdContext->i[0] += ((uint32_t)inLen << 3);
-  mdContext->i[1] += ((uint32_t)inLen >> 29);
-
-  while (inLen--) {
-    /* add new character to buffer, increment mdi */
-    mdContext->in[mdi++] = *inBuf++;
-
-    /* transform if necessary */
-    if (mdi == 0x40) {
-      for (i = 0, ii = 0; i < 16; i++, ii += 4)
-        in[i] = (((uint32_t)mdContext->in[ii + 3]) << 24) | (((uint32_t)mdContext->in[ii + 2]) << 16) |
-                (((uint32_t)mdContext->in[ii + 1]) << 8) | ((uint32_t)mdContext->in[ii]);
-      Transform(mdContext->buf, in);
-      mdi = 0;
+  bits = ((uint64_t)mdContext->i[1] << 32 | mdContext->i[0]) + ((uint64_t)inLen << 3);
+  mdContext->i[0] = (uint32_t)bits;
+  mdContext->i[1] = (uint32_t)(bits >> 32);
+
+  /* complete a buffered block first */
+  if (mdi > 0) {
+    fill = 64 - mdi;
+    if (inLen < fill) {
+      memcpy(mdContext->in + mdi, p, inLen);
+      return;
     }
+    memcpy(mdContext->in + mdi, p, fill);
+    Transform(mdContext->buf, mdContext->in, 1);
+    p += fill;
+    inLen -= fill;
+  }
+
+  if (inLen >= 64) {
+    Transform(mdContext->buf, p, inLen / 64);
+    p += inLen & ~(size_t)0x3F;
+    inLen &= 0x3F;
   }
+  if (inLen > 0) memcpy(mdContext->in, p, inLen);
 }
 
 /* The routine MD5Final terminates the message-digest computation and
 ends with the desired message digest in mdContext->digest[0...15].
 */
 void MD5Final(MD5_CTX *mdContext) {
-  uint32_t     in[16];
-  int          mdi;
-  unsigned int i, ii;
-  unsigned int padLen;
+  uint32_t bits[2];
+  size_t   mdi;
 
   /* save number of bits */
-  in[14] = mdContext->i[0];
-  in[15] = mdContext->i[1];
+  bits[0] = mdContext->i[0];
+  bits[1] = mdContext->i[1];
 
   /* compute number of bytes mod 64 */
-  mdi = (int)((mdContext->i[0] >> 3) & 0x3F);
+  mdi = (size_t)((mdContext->i[0] >> 3) & 0x3F);
 
   /* pad out to 56 mod 64 */
-  padLen = (mdi < 56) ? (56 - mdi) : (120 - mdi);
-  MD5Update(mdContext, PADDING, padLen);
+  mdContext->in[mdi++] = 0x80;
+  if (mdi > 56) {
+    memset(mdContext->in + mdi, 0, 64 - mdi);
+    Transform(mdContext->buf, mdContext->in, 1);
+    mdi = 0;
+  }
+  memset(mdContext->in + mdi, 0, 56 - mdi);
 
   /* append length in bits and transform */
-  for (i = 0, ii = 0; i < 14; i++, ii += 4)
-    in[i] = (((uint32_t)mdContext->in[ii + 3]) << 24) | (((uint32_t)mdContext->in[ii + 2]) << 16) |
-            (((uint32_t)mdContext->in[ii + 1]) << 8) | ((uint32_t)mdContext->in[ii]);
-  Transform(mdContext->buf, in);
+  Encode(mdContext->in + 56, bits, 2);
+  Transform(mdContext->buf, mdContext->in, 1);
 
   /* store buffer in digest */
-  for (i = 0, ii = 0; i < 4; i++, ii += 4) {
-    mdContext->digest[ii] = (uint8_t)(mdContext->buf[i] & 0xFF);
-    mdContext->digest[ii + 1] = (uint8_t)((mdContext->buf[i] >> 8) & 0xFF);
-    mdContext->digest[ii + 2] = (uint8_t)((mdContext->buf[i] >> 16) & 0xFF);
-    mdContext->digest[ii + 3] = (uint8_t)((mdContext->buf[i] >> 24) & 0xFF);
+  Encode(mdContext->digest, mdContext->buf, 4);
+}
+
+void md5(const void *buf, size_t len, uint8_t out[16]) {
+  MD5_CTX ctx;
+
+  MD5Init(&ctx);
+  MD5Update(&ctx, buf, len);
+  MD5Final(&ctx);
+  memcpy(out, ctx.digest, 16);
+}
+
+/* Test suite from RFC 1321, appendix A.5 */
+int MD5SelfTest(void) {
+  static const char *const vectors[][2] = {
+      {"", "d41d8cd98f00b204e9800998ecf8427e"},
+      {"a", "0cc175b9c0f1b6a831c399e269772661"},
+      {"abc", "900150983cd24fb0d6963f7d28e17f72"},
+      {"message digest", "f96b697d7cb7938d525a2f31aaf161d0"},
+      {"abcdefghijklmnopqrstuvwxyz", "c3fcd3d76192e4007dfb496cca67e13b"},
+      {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", "d174ab98d277d9f5a5611c2c9f419d9f"},
+      {"12345678901234567890123456789012345678901234567890123456789012345678901234567890",
+       "57edf4a22be3c955ac49da2e2107b67a"},
+  };
+  static const char hex[] = "0123456789abcdef";
+  uint8_t digest[16];
+  char    s[33];
+  size_t  i, j, len;
+  MD5_CTX ctx;
+
+  for (i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+    len = strlen(vectors[i][0]);
+
+    /* one-shot, then one byte at a time through the partial block buffer */
+    md5(vectors[i][0], len, digest);
+    for (j = 0; j < 16; j++) {
+      s[2 * j] = hex[digest[j] >> 4];
+      s[2 * j + 1] = hex[digest[j] & 0xF];
+    }
+    s[32] = 0;
+    if (strcmp(s, vectors[i][1]) != 0) return (int)i + 1;
+
+    MD5Init(&ctx);
+    for (j = 0; j < len; j++) MD5Update(&ctx, vectors[i][0] + j, 1);
+    MD5Final(&ctx);
+    if (memcmp(ctx.digest, digest, 16) != 0) return (int)i + 1;
   }
+  return 0;
 }
 
-/* Basic MD5 step. Transforms buf based on in.
+/* Basic MD5 step. Transforms buf based on each 64-byte block, with the
+   state kept in registers across blocks.
  */
-static void Transform(uint32_t *buf, uint32_t *in) {
+static void Transform(uint32_t *buf, const uint8_t *block, size_t blocks) {
   uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+  uint32_t X[16];
+
+  for (; blocks > 0; blocks--, block += 64) {
+    uint32_t aa = a, bb = b, cc = c, dd = d;
+
+    Decode(X, block, 16);
 
 /* Round 1 */
 #define S11 7
@@ -144,22 +225,22 @@ static void Transform(uint32_t *buf, uint32_t *in) {
 #define S13 17
 #define S14 22
 
-  FF(a, b, c, d, in[0], S11, 3614090360U);  /* 1 */
-  FF(d, a, b, c, in[1], S12, 3905402710U);  /* 2 */
-  FF(c, d, a, b, in[2], S13, 606105819U);   /* 3 */
-  FF(b, c, d, a, in[3], S14, 3250441966U);  /* 4 */
-  FF(a, b, c, d, in[4], S11, 4118548399U);  /* 5 */
-  FF(d, a, b, c, in[5], S12, 1200080426U);  /* 6 */
-  FF(c, d, a, b, in[6], S13, 2821735955U);  /* 7 */
-  FF(b, c, d, a, in[7], S14, 4249261313U);  /* 8 */
-  FF(a, b, c, d, in[8], S11, 1770035416U);  /* 9 */
-  FF(d, a, b, c, in[9], S12, 2336552879U);  /* 10 */
-  FF(c, d, a, b, in[10], S13, 4294925233U); /* 11 */
-  FF(b, c, d, a, in[11], S14, 2304563134U); /* 12 */
-  FF(a, b, c, d, in[12], S11, 1804603682U); /* 13 */
-  FF(d, a, b, c, in[13], S12, 4254626195U); /* 14 */
-  FF(c, d, a, b, in[14], S13, 2792965006U); /* 15 */
-  FF(b, c, d, a, in[15], S14, 1236535329U); /* 16 */
+    FF(a, b, c, d, X[0], S11, 3614090360U);   /* 1 */
+    FF(d, a, b, c, X[1], S12, 3905402710U);   /* 2 */
+    FF(c, d, a, b, X[2], S13, 606105819U);    /* 3 */
+    FF(b, c, d, a, X[3], S14, 3250441966U);   /* 4 */
+    FF(a, b, c, d, X[4], S11, 4118548399U);   /* 5 */
+    FF(d, a, b, c, X[5], S12, 1200080426U);   /* 6 */
+    FF(c, d, a, b, X[6], S13, 2821735955U);   /* 7 */
+    FF(b, c, d, a, X[7], S14, 4249261313U);   /* 8 */
+    FF(a, b, c, d, X[8], S11, 1770035416U);   /* 9 */
+    FF(d, a, b, c, X[9], S12, 2336552879U);   /* 10 */
+    FF(c, d, a, b, X[10], S13, 4294925233U);  /* 11 */
+    FF(b, c, d, a, X[11], S14, 2304563134U);  /* 12 */
+    FF(a, b, c, d, X[12], S11, 1804603682U);  /* 13 */
+    FF(d, a, b, c, X[13], S12, 4254626195U);  /* 14 */
+    FF(c, d, a, b, X[14], S13, 2792965006U);  /* 15 */
+    FF(b, c, d, a, X[15], S14, 1236535329U);  /* 16 */
 
 /* Round 2 */
 #define S21 5
@@ -167,22 +248,22 @@ static void Transform(uint32_t *buf, uint32_t *in) {
 #define S23 14
 #define S24 20
 
-  GG(a, b, c, d, in[1], S21, 4129170786U);  /* 17 */
-  GG(d, a, b, c, in[6], S22, 3225465664U);  /* 18 */
-  GG(c, d, a, b, in[11], S23, 643717713U);  /* 19 */
-  GG(b, c, d, a, in[0], S24, 3921069994U);  /* 20 */
-  GG(a, b, c, d, in[5], S21, 3593408605U);  /* 21 */
-  GG(d, a, b, c, in[10], S22, 38016083U);   /* 22 */
-  GG(c, d, a, b, in[15], S23, 3634488961U); /* 23 */
-  GG(b, c, d, a, in[4], S24, 3889429448U);  /* 24 */
-  GG(a, b, c, d, in[9], S21, 568446438U);   /* 25 */
-  GG(d, a, b, c, in[14], S22, 3275163606U); /* 26 */
-  GG(c, d, a, b, in[3], S23, 4107603335U);  /* 27 */
-  GG(b, c, d, a, in[8], S24, 1163531501U);  /* 28 */
-  GG(a, b, c, d, in[13], S21, 2850285829U); /* 29 */
-  GG(d, a, b, c, in[2], S22, 4243563512U);  /* 30 */
-  GG(c, d, a, b, in[7], S23, 1735328473U);  /* 31 */
-  GG(b, c, d, a, in[12], S24, 2368359562U); /* 32 */
+    GG(a, b, c, d, X[1], S21, 4129170786U);   /* 17 */
+    GG(d, a, b, c, X[6], S22, 3225465664U);   /* 18 */
+    GG(c, d, a, b, X[11], S23, 643717713U);   /* 19 */
+    GG(b, c, d, a, X[0], S24, 3921069994U);   /* 20 */
+    GG(a, b, c, d, X[5], S21, 3593408605U);   /* 21 */
+    GG(d, a, b, c, X[10], S22, 38016083U);    /* 22 */
+    GG(c, d, a, b, X[15], S23, 3634488961U);  /* 23 */
+    GG(b, c, d, a, X[4], S24, 3889429448U);   /* 24 */
+    GG(a, b, c, d, X[9], S21, 568446438U);    /* 25 */
+    GG(d, a, b, c, X[14], S22, 3275163606U);  /* 26 */
+    GG(c, d, a, b, X[3], S23, 4107603335U);   /* 27 */
+    GG(b, c, d, a, X[8], S24, 1163531501U);   /* 28 */
+    GG(a, b, c, d, X[13], S21, 2850285829U);  /* 29 */
+    GG(d, a, b, c, X[2], S22, 4243563512U);   /* 30 */
+    GG(c, d, a, b, X[7], S23, 1735328473U);   /* 31 */
+    GG(b, c, d, a, X[12], S24, 2368359562U);  /* 32 */
 
 /* Round 3 */
 #define S31 4
@@ -190,22 +271,22 @@ static void Transform(uint32_t *buf, uint32_t *in) {
 #define S33 16
 #define S34 23
 
-  HH(a, b, c, d, in[5], S31, 4294588738U);  /* 33 */
-  HH(d, a, b, c, in[8], S32, 2272392833U);  /* 34 */
-  HH(c, d, a, b, in[11], S33, 1839030562U); /* 35 */
-  HH(b, c, d, a, in[14], S34, 4259657740U); /* 36 */
-  HH(a, b, c, d, in[1], S31, 2763975236U);  /* 37 */
-  HH(d, a, b, c, in[4], S32, 1272893353U);  /* 38 */
-  HH(c, d, a, b, in[7], S33, 4139469664U);  /* 39 */
-  HH(b, c, d, a, in[10], S34, 3200236656U); /* 40 */
-  HH(a, b, c, d, in[13], S31, 681279174U);  /* 41 */
-  HH(d, a, b, c, in[0], S32, 3936430074U);  /* 42 */
-  HH(c, d, a, b, in[3], S33, 3572445317U);  /* 43 */
-  HH(b, c, d, a, in[6], S34, 76029189U);    /* 44 */
-  HH(a, b, c, d, in[9], S31, 3654602809U);  /* 45 */
-  HH(d, a, b, c, in[12], S32, 3873151461U); /* 46 */
-  HH(c, d, a, b, in[15], S33, 530742520U);  /* 47 */
-  HH(b, c, d, a, in[2], S34, 3299628645U);  /* 48 */
+    HH(a, b, c, d, X[5], S31, 4294588738U);   /* 33 */
+    HH(d, a, b, c, X[8], S32, 2272392833U);   /* 34 */
+    HH(c, d, a, b, X[11], S33, 1839030562U);  /* 35 */
+    HH(b, c, d, a, X[14], S34, 4259657740U);  /* 36 */
+    HH(a, b, c, d, X[1], S31, 2763975236U);   /* 37 */
+    HH(d, a, b, c, X[4], S32, 1272893353U);   /* 38 */
+    HH(c, d, a, b, X[7], S33, 4139469664U);   /* 39 */
+    HH(b, c, d, a, X[10], S34, 3200236656U);  /* 40 */
+    HH(a, b, c, d, X[13], S31, 681279174U);   /* 41 */
+    HH(d, a, b, c, X[0], S32, 3936430074U);   /* 42 */
+    HH(c, d, a, b, X[3], S33, 3572445317U);   /* 43 */
+    HH(b, c, d, a, X[6], S34, 76029189U);     /* 44 */
+    HH(a, b, c, d, X[9], S31, 3654602809U);   /* 45 */
+    HH(d, a, b, c, X[12], S32, 3873151461U);  /* 46 */
+    HH(c, d, a, b, X[15], S33, 530742520U);   /* 47 */
+    HH(b, c, d, a, X[2], S34, 3299628645U);   /* 48 */
 
 /* Round 4 */
 #define S41 6
@@ -213,25 +294,31 @@ static void Transform(uint32_t *buf, uint32_t *in) {
 #define S43 15
 #define S44 21
 
-  II(a, b, c, d, in[0], S41, 4096336452U);  /* 49 */
-  II(d, a, b, c, in[7], S42, 1126891415U);  /* 50 */
-  II(c, d, a, b, in[14], S43, 2878612391U); /* 51 */
-  II(b, c, d, a, in[5], S44, 4237533241U);  /* 52 */
-  II(a, b, c, d, in[12], S41, 1700485571U); /* 53 */
-  II(d, a, b, c, in[3], S42, 2399980690U);  /* 54 */
-  II(c, d, a, b, in[10], S43, 4293915773U); /* 55 */
-  II(b, c, d, a, in[1], S44, 2240044497U);  /* 56 */
-  II(a, b, c, d, in[8], S41, 1873313359U);  /* 57 */
-  II(d, a, b, c, in[15], S42, 4264355552U); /* 58 */
-  II(c, d, a, b, in[6], S43, 2734768916U);  /* 59 */
-  II(b, c, d, a, in[13], S44, 1309151649U); /* 60 */
-  II(a, b, c, d, in[4], S41, 4149444226U);  /* 61 */
-  II(d, a, b, c, in[11], S42, 3174756917U); /* 62 */
-  II(c, d, a, b, in[2], S43, 718787259U);   /* 63 */
-  II(b, c, d, a, in[9], S44, 3951481745U);  /* 64 */
-
-  buf[0] += a;
-  buf[1] += b;
-  buf[2] += c;
-  buf[3] += d;
-}
\ No newline at end of file
+    II(a, b, c, d, X[0], S41, 4096336452U);   /* 49 */
+    II(d, a, b, c, X[7], S42, 1126891415U);   /* 50 */
+    II(c, d, a, b, X[14], S43, 2878612391U);  /* 51 */
+    II(b, c, d, a, X[5], S44, 4237533241U);   /* 52 */
+    II(a, b, c, d, X[12], S41, 1700485571U);  /* 53 */
+    II(d, a, b, c, X[3], S42, 2399980690U);   /* 54 */
+    II(c, d, a, b, X[10], S43, 4293915773U);  /* 55 */
+    II(b, c, d, a, X[1], S44, 2240044497U);   /* 56 */
+    II(a, b, c, d, X[8], S41, 1873313359U);   /* 57 */
+    II(d, a, b, c, X[15], S42, 4264355552U);  /* 58 */
+    II(c, d, a, b, X[6], S43, 2734768916U);   /* 59 */
+    II(b, c, d, a, X[13], S44, 1309151649U);  /* 60 */
+    II(a, b, c, d, X[4], S41, 4149444226U);   /* 61 */
+    II(d, a, b, c, X[11], S42, 3174756917U);  /* 62 */
+    II(c, d, a, b, X[2], S43, 718787259U);    /* 63 */
+    II(b, c, d, a, X[9], S44, 3951481745U);   /* 64 */
+
+    a += aa;
+    b += bb;
+    c += cc;
+    d += dd;
+  }
+
+  buf[0] = a;
+  buf[1] = b;
+  buf[2] = c;
+  buf[3] = d;
+}
@@ -1,6 +1,7 @@
 #ifndef _taos_md5_header_
 #define _taos_md5_header_
 
+#include <stddef.h>
 #include <stdint.h>
 
 typedef struct {
@@ -11,7 +12,13 @@ typedef struct {
 } MD5_CTX;
 
 void MD5Init(MD5_CTX *mdContext);
-void MD5Update(MD5_CTX *mdContext, uint8_t *inBuf, unsigned int inLen);
+void MD5Update(MD5_CTX *mdContext, const void *inBuf, size_t inLen);
 void MD5Final(MD5_CTX *mdContext);
 
-#endif
\ No newline at end of file
+/* One-shot digest of buf[0..len-1] into out[0..15] */
+void md5(const void *buf, size_t len, uint8_t out[16]);
+
+/* Checks the RFC 1321 test suite, returns 0 when every vector matches */
+int MD5SelfTest(void);
+
+#endif
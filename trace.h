@@ -0,0 +1,238 @@
+#ifndef TRACE_H__
+#define TRACE_H__
+
+/*
+ * Span tracing in the Chrome trace-event format.
+ *
+ * trace_begin() and trace_end() append "B" and "E" events to a buffer owned
+ * by the calling thread, found through a thread-local pointer and linked
+ * into the registry with a CAS on first use, like the histograms in
+ * histo.h. Buffers grow in blocks and are only read by trace_write() once
+ * the traced threads are done, so recording takes no locks. While tracing
+ * is disabled both calls return after one relaxed load.
+ *
+ * trace_write() produces a JSON file that chrome://tracing and Perfetto
+ * open directly, with one track per thread. Timestamps use the same
+ * monotonic clock as the histograms (histo_now_us).
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "histo.h"
+
+#define TRACE_ARG_MAX 32
+#define TRACE_BLOCK_EVENTS 4096
+// 每个线程最多记录的事件数, 超过后新的 span 被丢弃
+#define TRACE_MAX_EVENTS (1 << 22)
+
+typedef struct trace_event {
+	const char* name;
+	uint64_t ts;
+	char phase;
+	// 可选的参数, 例如单词
+	char arg[TRACE_ARG_MAX];
+} trace_event_t;
+
+typedef struct trace_block {
+	struct trace_block* next;
+	size_t count;
+	trace_event_t events[TRACE_BLOCK_EVENTS];
+} trace_block_t;
+
+typedef struct trace_local {
+	struct trace_local* next;
+	uint32_t tid;
+	const char* name;
+	trace_block_t* head;
+	trace_block_t* tail;
+	size_t events;
+	// 丢弃的 span 数, 以及还没有结束的被丢弃的 span 层数
+	size_t dropped;
+	size_t skip;
+} trace_local_t;
+
+typedef struct trace_registry {
+	atomic_int enabled;
+	atomic_uint next_tid;
+	_Atomic(trace_local_t*) head;
+	uint64_t t0;
+} trace_registry_t;
+
+static inline void trace_init(trace_registry_t* r, int enabled)
+{
+	atomic_init(&r->enabled, enabled);
+	atomic_init(&r->next_tid, 1);
+	atomic_init(&r->head, NULL);
+	r->t0 = histo_now_us();
+}
+
+static inline int trace_enabled(trace_registry_t* r)
+{
+	return atomic_load_explicit(&r->enabled, memory_order_relaxed);
+}
+
+// 当前线程的缓冲区, 与 histo_local 相同. 线程退出后保留到 trace_write
+static inline trace_local_t* trace_local(trace_registry_t* r)
+{
+	static _Thread_local trace_local_t* local;
+	if (local == NULL) {
+		trace_local_t* l = calloc(1, sizeof(trace_local_t));
+		if (l == NULL)
+			return NULL;
+		l->tid = atomic_fetch_add(&r->next_tid, 1);
+		l->next = atomic_load(&r->head);
+		while (!atomic_compare_exchange_weak(&r->head, &l->next, l))
+			;
+		local = l;
+	}
+	return local;
+}
+
+static trace_event_t* trace_append(trace_local_t* l)
+{
+	if (l->tail == NULL || l->tail->count == TRACE_BLOCK_EVENTS) {
+		trace_block_t* b = malloc(sizeof(trace_block_t));
+		if (b == NULL)
+			return NULL;
+		b->next = NULL;
+		b->count = 0;
+		if (l->tail)
+			l->tail->next = b;
+		else
+			l->head = b;
+		l->tail = b;
+	}
+	l->events++;
+	return &l->tail->events[l->tail->count++];
+}
+
+// 在 Perfetto 中显示的线程名, name 需要一直有效
+static inline void trace_thread_name(trace_registry_t* r, const char* name)
+{
+	trace_local_t* l;
+	if (trace_enabled(r) && (l = trace_local(r)) != NULL)
+		l->name = name;
+}
+
+// 开始名为 name 的 span, name 需要一直有效, arg 可以为 NULL
+static inline void trace_begin(trace_registry_t* r, const char* name, const char* arg)
+{
+	if (!trace_enabled(r))
+		return;
+	trace_local_t* l = trace_local(r);
+	if (l == NULL)
+		return;
+	trace_event_t* e = NULL;
+	if (l->skip > 0 || l->events >= TRACE_MAX_EVENTS || (e = trace_append(l)) == NULL) {
+		l->dropped++;
+		l->skip++;
+		return;
+	}
+	e->name = name;
+	e->phase = 'B';
+	e->ts = histo_now_us();
+	e->arg[0] = 0;
+	if (arg) {
+		size_t n = strlen(arg);
+		if (n >= TRACE_ARG_MAX)
+			n = TRACE_ARG_MAX - 1;
+		memcpy(e->arg, arg, n);
+		e->arg[n] = 0;
+	}
+}
+
+// 结束当前线程最近开始的 span. 结束事件不受上限限制, 保证 span 成对
+static inline void trace_end(trace_registry_t* r, const char* name)
+{
+	if (!trace_enabled(r))
+		return;
+	trace_local_t* l = trace_local(r);
+	if (l == NULL)
+		return;
+	if (l->skip > 0) {
+		l->skip--;
+		return;
+	}
+	trace_event_t* e = trace_append(l);
+	if (e == NULL)
+		return;
+	e->name = name;
+	e->phase = 'E';
+	e->ts = histo_now_us();
+	e->arg[0] = 0;
+}
+
+static void trace_escape(FILE* f, const char* s)
+{
+	for (; *s; s++) {
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+}
+
+// 写出所有线程的事件并释放缓冲区, 需要在被跟踪的线程结束后调用. 返回写出的事件数, 失败返回 -1
+static long trace_write(trace_registry_t* r, const char* path)
+{
+	FILE* f = fopen(path, "w");
+	if (f == NULL) {
+		fprintf(stderr, "error: Can't open %s\n", path);
+		return -1;
+	}
+	atomic_store(&r->enabled, 0);
+
+	long count = 0;
+	size_t dropped = 0;
+	const char* sep = "\n";
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	trace_local_t* l = atomic_exchange(&r->head, NULL);
+	while (l) {
+		if (l->name) {
+			fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"", sep, l->tid);
+			trace_escape(f, l->name);
+			fprintf(f, "\"}}");
+			sep = ",\n";
+		}
+		for (trace_block_t* b = l->head; b;) {
+			for (size_t i = 0; i < b->count; i++) {
+				const trace_event_t* e = &b->events[i];
+				fprintf(f, "%s{\"name\":\"", sep);
+				trace_escape(f, e->name);
+				fprintf(f, "\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":1,\"tid\":%u", e->phase,
+				        (unsigned long long)(e->ts - r->t0), l->tid);
+				if (e->arg[0]) {
+					fprintf(f, ",\"args\":{\"word\":\"");
+					trace_escape(f, e->arg);
+					fprintf(f, "\"}");
+				}
+				fprintf(f, "}");
+				sep = ",\n";
+				count++;
+			}
+			trace_block_t* next = b->next;
+			free(b);
+			b = next;
+		}
+		dropped += l->dropped;
+		// 线程局部指针仍然指向 l, 不释放
+		l->head = l->tail = NULL;
+		l = l->next;
+	}
+	fprintf(f, "\n]}\n");
+	if (fclose(f)) {
+		fprintf(stderr, "error: Can't write %s\n", path);
+		return -1;
+	}
+	if (dropped > 0)
+		fprintf(stderr, "warning: %zu trace spans dropped.\n", dropped);
+	return count;
+}
+
+#endif
@@ -0,0 +1,286 @@
+#ifndef TRIE_H__
+#define TRIE_H__
+
+/*
+ * Static path-compressed trie over a sorted key set, serialized in preorder.
+ *
+ *   node   varint (children << 1 | terminal)
+ *          children x (varint edge len, edge bytes, varint subtree bytes,
+ *                      varint subtree keys), in label order
+ *          the child subtrees, in the same order
+ *
+ * Because a terminal node comes before its children and children are sorted,
+ * the preorder rank of a key equals its index in the sorted key set, which is
+ * also its entry index in the dictionary image. All keys under a prefix form
+ * one contiguous range of indexes.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rapidstring.h"
+
+// 补全时还原 key 的缓冲区大小, 不小于镜像允许的最长 key
+#define TRIE_MAX_KEY 256
+
+// 返回非 0 时停止枚举
+typedef int (*trie_visit_fn)(const char* key, size_t len, uint32_t index, void* ctx);
+
+static inline void trie_put_varint(rapidstring* s, size_t v)
+{
+	char b[10];
+	size_t n = 0;
+	do {
+		b[n++] = (char)((v & 0x7F) | (v > 0x7F ? 0x80 : 0));
+		v >>= 7;
+	} while (v);
+	rs_cat_n(s, b, n);
+}
+
+static inline const uint8_t* trie_varint(const uint8_t* p, const uint8_t* end, size_t* value)
+{
+	size_t v = 0;
+	for (int shift = 0; p < end && shift < 64; shift += 7) {
+		uint8_t b = *p++;
+		v |= (size_t)(b & 0x7F) << shift;
+		if ((b & 0x80) == 0) {
+			*value = v;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static size_t trie_lcp(const char* a, size_t a_len, const char* b, size_t b_len)
+{
+	size_t n = 0;
+	while (n < a_len && n < b_len && a[n] == b[n])
+		n++;
+	return n;
+}
+
+// 把 keys[lo, hi) 中共享前 depth 字节的子树写入 out
+static void trie_build_node(rapidstring* out, const char* const* keys, const size_t* lens,
+                            uint32_t lo, uint32_t hi, size_t depth)
+{
+	int terminal = lo < hi && lens[lo] == depth;
+	if (terminal)
+		lo++;
+
+	// 按 depth 处的字节分组, 每组是一个子节点
+	size_t children = 0;
+	for (uint32_t i = lo; i < hi; children++) {
+		uint32_t j = i + 1;
+		while (j < hi && keys[j][depth] == keys[i][depth])
+			j++;
+		i = j;
+	}
+
+	rapidstring table, subtrees;
+	rs_init(&table);
+	rs_init(&subtrees);
+	for (uint32_t i = lo; i < hi;) {
+		uint32_t j = i + 1;
+		while (j < hi && keys[j][depth] == keys[i][depth])
+			j++;
+		// 有序集合中首尾两个 key 的公共前缀就是整组的公共前缀
+		size_t edge_end = trie_lcp(keys[i], lens[i], keys[j - 1], lens[j - 1]);
+
+		rapidstring child;
+		rs_init(&child);
+		trie_build_node(&child, keys, lens, i, j, edge_end);
+
+		trie_put_varint(&table, edge_end - depth);
+		rs_cat_n(&table, keys[i] + depth, edge_end - depth);
+		trie_put_varint(&table, rs_len(&child));
+		trie_put_varint(&table, j - i);
+		rs_cat_rs(&subtrees, &child);
+		rs_free(&child);
+		i = j;
+	}
+
+	trie_put_varint(out, (children << 1) | (size_t)terminal);
+	rs_cat_rs(out, &table);
+	rs_cat_rs(out, &subtrees);
+	rs_free(&table);
+	rs_free(&subtrees);
+}
+
+// keys 必须已按 memcmp 排序且不重复
+static void trie_build(rapidstring* out, uint32_t n, const char* const* keys, const size_t* lens)
+{
+	trie_build_node(out, keys, lens, 0, n, 0);
+}
+
+typedef struct trie_child {
+	const uint8_t* edge;
+	size_t edge_len;
+	const uint8_t* node;
+	size_t size;
+	// 子树中第一个 key 的序号
+	uint32_t index;
+} trie_child_t;
+
+typedef struct trie_node {
+	int terminal;
+	size_t children;
+	// 子节点表的当前位置和子树区的当前位置
+	const uint8_t* table;
+	const uint8_t* subtree;
+	const uint8_t* end;
+	uint32_t index;
+} trie_node_t;
+
+// 读取节点头, index 为该节点子树中第一个 key 的序号
+static const uint8_t* trie_open_node(trie_node_t* n, const uint8_t* p, const uint8_t* end, uint32_t index)
+{
+	size_t header;
+	if ((p = trie_varint(p, end, &header)) == NULL)
+		return NULL;
+	n->terminal = header & 1;
+	n->children = header >> 1;
+	n->table = p;
+	n->end = end;
+	n->index = index + (uint32_t)n->terminal;
+
+	// 跳过子节点表, 找到子树区的开始位置
+	for (size_t i = 0; i < n->children; i++) {
+		size_t len, size, count;
+		if ((p = trie_varint(p, end, &len)) == NULL || len > (size_t)(end - p))
+			return NULL;
+		p += len;
+		if ((p = trie_varint(p, end, &size)) == NULL || (p = trie_varint(p, end, &count)) == NULL)
+			return NULL;
+	}
+	n->subtree = p;
+	return p;
+}
+
+// 依次读取子节点, 没有更多子节点或数据损坏时返回 0
+static int trie_next_child(trie_node_t* n, trie_child_t* c)
+{
+	size_t count;
+	if (n->children == 0)
+		return 0;
+	const uint8_t* p = trie_varint(n->table, n->end, &c->edge_len);
+	if (p == NULL || c->edge_len > (size_t)(n->end - p))
+		return 0;
+	c->edge = p;
+	p += c->edge_len;
+	if ((p = trie_varint(p, n->end, &c->size)) == NULL || (p = trie_varint(p, n->end, &count)) == NULL)
+		return 0;
+	if (c->size > (size_t)(n->end - n->subtree))
+		return 0;
+	c->node = n->subtree;
+	c->index = n->index;
+	n->table = p;
+	n->subtree += c->size;
+	n->index += (uint32_t)count;
+	n->children--;
+	return 1;
+}
+
+// 返回 key 的序号, 不存在时返回 -1
+static inline long trie_find(const uint8_t* trie, size_t size, const char* key, size_t len)
+{
+	const uint8_t* end = trie + size;
+	const uint8_t* p = trie;
+	uint32_t index = 0;
+
+	for (;;) {
+		trie_node_t n;
+		trie_child_t c;
+		if (trie_open_node(&n, p, end, index) == NULL)
+			return -1;
+		if (len == 0)
+			return n.terminal ? (long)index : -1;
+		for (;;) {
+			if (!trie_next_child(&n, &c))
+				return -1;
+			if (c.edge[0] == (uint8_t)key[0])
+				break;
+		}
+		if (c.edge_len > len || memcmp(c.edge, key, c.edge_len) != 0)
+			return -1;
+		key += c.edge_len;
+		len -= c.edge_len;
+		p = c.node;
+		index = c.index;
+	}
+}
+
+typedef struct trie_walk {
+	char key[TRIE_MAX_KEY];
+	size_t limit;
+	size_t found;
+	trie_visit_fn visit;
+	void* ctx;
+} trie_walk_t;
+
+// 按顺序枚举子树中的 key, key[0, depth) 为子树的前缀
+static int trie_walk_node(trie_walk_t* w, const uint8_t* p, const uint8_t* end, uint32_t index, size_t depth)
+{
+	trie_node_t n;
+	trie_child_t c;
+	if (trie_open_node(&n, p, end, index) == NULL)
+		return 1;
+	if (n.terminal) {
+		if (w->found >= w->limit || w->visit(w->key, depth, index, w->ctx))
+			return 1;
+		w->found++;
+	}
+	while (trie_next_child(&n, &c)) {
+		if (w->found >= w->limit)
+			return 1;
+		if (depth + c.edge_len > TRIE_MAX_KEY)
+			return 1;
+		memcpy(w->key + depth, c.edge, c.edge_len);
+		if (trie_walk_node(w, c.node, c.node + c.size, c.index, depth + c.edge_len))
+			return 1;
+	}
+	return 0;
+}
+
+// 按字典序枚举以 prefix 开头的 key, 最多 limit 个. 返回枚举的数量
+static size_t trie_complete(const uint8_t* trie, size_t size, const char* prefix, size_t len,
+                            size_t limit, trie_visit_fn visit, void* ctx)
+{
+	const uint8_t* end = trie + size;
+	const uint8_t* p = trie;
+	uint32_t index = 0;
+	size_t depth = 0;
+	trie_walk_t w;
+
+	if (len > TRIE_MAX_KEY || limit == 0)
+		return 0;
+	w.limit = limit;
+	w.found = 0;
+	w.visit = visit;
+	w.ctx = ctx;
+
+	while (depth < len) {
+		trie_node_t n;
+		trie_child_t c;
+		if (trie_open_node(&n, p, end, index) == NULL)
+			return 0;
+		for (;;) {
+			if (!trie_next_child(&n, &c))
+				return 0;
+			if (c.edge[0] == (uint8_t)prefix[depth])
+				break;
+		}
+		// 前缀可能在边的中间结束
+		size_t n_cmp = len - depth < c.edge_len ? len - depth : c.edge_len;
+		if (memcmp(c.edge, prefix + depth, n_cmp) != 0 || depth + c.edge_len > TRIE_MAX_KEY)
+			return 0;
+		memcpy(w.key + depth, c.edge, c.edge_len);
+		depth += c.edge_len;
+		p = c.node;
+		end = c.node + c.size;
+		index = c.index;
+	}
+	trie_walk_node(&w, p, end, index, depth);
+	return w.found;
+}
+
+#endif